@@ -0,0 +1,146 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Host benchmark: async_queue's mutex backend against the mpmc_ring backend.
+ *
+ * Build and run on the host, from the top directory:
+ *
+ *   g++ -std=c++23 -O2 -pthread -Isrc bench/async_queue_bench.cpp -o async_queue_bench
+ *   ./async_queue_bench
+ *
+ * Two workloads:
+ *
+ *   - throughput: N producers and N consumers moving 200k items each, through a queue
+ *     with capacity 64 (the ring) or unbounded (the mutex queue);
+ *
+ *   - handoff: the thread pool's pattern, one producer pushing one item at a time to two
+ *     idle consumers; reports the latency from push() until a consumer has the item.
+ */
+
+#include <algorithm>            // ranges::sort()
+#include <atomic>
+#include <chrono>
+#include <cstdio>               // printf()
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "async_queue.hpp"
+
+
+using namespace std::literals;
+
+using clock_type = std::chrono::steady_clock;
+
+
+namespace {
+
+    constexpr unsigned items_per_producer = 200'000;
+    constexpr unsigned handoff_rounds = 20'000;
+
+
+    struct mutex_backend {
+        template<typename T>
+        using rebind = std::queue<T>;
+    };
+
+
+    struct ring_backend {
+        template<typename T>
+        using rebind = mpmc_ring<T, 64>;
+    };
+
+
+    template<typename Backend,
+             typename T>
+    using queue_for = async_queue<T, typename Backend::template rebind<T>>;
+
+
+    template<typename Backend>
+    double
+    throughput(unsigned threads)
+    {
+        queue_for<Backend, unsigned> q;
+        std::vector<std::jthread> workers;
+        auto start = clock_type::now();
+        for (unsigned i = 0; i < threads; ++i) {
+            workers.emplace_back([&q]
+            {
+                for (unsigned j = 0; j < items_per_producer; ++j)
+                    q.push(j);
+            });
+            workers.emplace_back([&q]
+            {
+                for (unsigned j = 0; j < items_per_producer; ++j)
+                    q.pop();
+            });
+        }
+        workers.clear();
+        return std::chrono::duration<double>(clock_type::now() - start).count();
+    }
+
+
+    template<typename Backend>
+    void
+    handoff(const char* name)
+    {
+        // The item is the time it was pushed.
+        queue_for<Backend, clock_type::time_point> q;
+        std::vector<double> latencies(handoff_rounds);
+        std::atomic<unsigned> done = 0;
+
+        std::vector<std::jthread> consumers;
+        for (int i = 0; i < 2; ++i)
+            consumers.emplace_back([&]
+            {
+                try {
+                    for (;;) {
+                        auto pushed = q.pop();
+                        auto dt = clock_type::now() - pushed;
+                        unsigned n = done++;
+                        latencies[n] = std::chrono::duration<double, std::micro>(dt).count();
+                    }
+                }
+                catch (typename decltype(q)::stop_request&) {}
+            });
+
+        for (unsigned i = 0; i < handoff_rounds; ++i) {
+            unsigned before = done;
+            q.push(clock_type::now());
+            // Wait until it's handled, so the consumers are idle again, like pool workers.
+            while (done == before)
+                std::this_thread::yield();
+        }
+        q.stop();
+        consumers.clear();
+
+        std::ranges::sort(latencies);
+        std::printf("handoff %-6s median %7.1f us, p99 %7.1f us\n",
+                    name,
+                    latencies[latencies.size() / 2],
+                    latencies[latencies.size() * 99 / 100]);
+    }
+
+} // namespace
+
+
+int
+main()
+{
+    std::printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+
+    for (unsigned n : {1u, 2u, 4u, 8u}) {
+        double m = throughput<mutex_backend>(n);
+        double r = throughput<ring_backend>(n);
+        std::printf("throughput %u+%u threads: mutex %.3f s, ring %.3f s\n", n, n, m, r);
+    }
+
+    handoff<mutex_backend>("mutex");
+    handoff<ring_backend>("ring");
+}
@@ -0,0 +1,148 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Host benchmark: how soon a finished DNS lookup gets handled by core::run().
+ *
+ * Build and run on the host, from the top directory:
+ *
+ *   g++ -std=c++23 -O2 -pthread -Isrc bench/completion_queue_bench.cpp src/thread_pool.cpp \
+ *       -o completion_queue_bench
+ *   ./completion_queue_bench
+ *
+ * Each round submits 8 tasks that take 5 to 60 ms, the slowest first, like lookups of
+ * names that resolve at different speeds. The collector latency is the time from a task
+ * finishing until the collecting thread handles its result. Three collectors:
+ *
+ *   - in-order: get() on each future, in the order they were submitted;
+ *
+ *   - scan: check every future without waiting, then wait up to 10 ms on the oldest one
+ *     (what core::run() did before);
+ *
+ *   - completion_queue: pop_for(), in the order they finish.
+ */
+
+#include <algorithm>            // ranges::max()
+#include <chrono>
+#include <cstdio>               // printf()
+#include <future>               // future_status
+#include <numeric>              // accumulate()
+#include <thread>
+#include <vector>
+
+#include "completion_queue.hpp"
+#include "thread_pool.hpp"
+
+
+using namespace std::literals;
+
+using clock_type = std::chrono::steady_clock;
+
+
+namespace {
+
+    constexpr int rounds = 20;
+    constexpr int tasks_per_round = 8;
+
+
+    // Returns when it finished.
+    clock_type::time_point
+    lookup(std::chrono::milliseconds duration)
+    {
+        std::this_thread::sleep_for(duration);
+        return clock_type::now();
+    }
+
+
+    std::vector<task_future<clock_type::time_point>>
+    launch(thread_pool& pool)
+    {
+        std::vector<task_future<clock_type::time_point>> futures;
+        for (int i = 0; i < tasks_per_round; ++i) {
+            auto duration = 60ms - i * 55ms / (tasks_per_round - 1);
+            futures.push_back(pool.submit(lookup, duration));
+        }
+        return futures;
+    }
+
+
+    double
+    latency_us(clock_type::time_point finished)
+    {
+        return std::chrono::duration<double, std::micro>(clock_type::now() - finished).count();
+    }
+
+
+    void
+    in_order(thread_pool& pool,
+             std::vector<double>& latencies)
+    {
+        for (auto& f : launch(pool))
+            latencies.push_back(latency_us(f.get()));
+    }
+
+
+    void
+    scan(thread_pool& pool,
+         std::vector<double>& latencies)
+    {
+        auto futures = launch(pool);
+        while (!futures.empty()) {
+            for (auto it = futures.begin(); it != futures.end();) {
+                if (it->wait_for(0s) == std::future_status::ready) {
+                    latencies.push_back(latency_us(it->get()));
+                    it = futures.erase(it);
+                } else
+                    ++it;
+            }
+            if (!futures.empty())
+                futures.front().wait_for(10ms);
+        }
+    }
+
+
+    void
+    completions(thread_pool& pool,
+                std::vector<double>& latencies)
+    {
+        completion_queue<clock_type::time_point> queue;
+        for (auto& f : launch(pool))
+            queue.add(std::move(f), 0);
+        while (!queue.empty())
+            if (auto c = queue.pop_for(1s))
+                latencies.push_back(latency_us(c->result.get()));
+    }
+
+
+    template<typename Collector>
+    void
+    measure(const char* name,
+            Collector collect)
+    {
+        thread_pool pool{tasks_per_round};
+        std::vector<double> latencies;
+        for (int i = 0; i < rounds; ++i)
+            collect(pool, latencies);
+        double mean = std::accumulate(latencies.begin(), latencies.end(), 0.0)
+            / latencies.size();
+        std::printf("%-18s mean %7.0f us, max %7.0f us\n",
+                    name,
+                    mean,
+                    std::ranges::max(latencies));
+    }
+
+} // namespace
+
+
+int
+main()
+{
+    measure("in-order get():", in_order);
+    measure("scan + 10 ms wait:", scan);
+    measure("completion_queue:", completions);
+}
@@ -0,0 +1,4 @@
+/* Host builds: what configure would define. */
+#define PACKAGE_NAME "Time Sync"
+#define PACKAGE_TARNAME "time-sync"
+#define PACKAGE_VERSION "host"
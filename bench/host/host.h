@@ -0,0 +1,38 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Forced include (-include) for host builds: the Wii U socket options that net::socket
+ * names. Most get dummy values, and are never set by the host programs.
+ *
+ * The reactor sets SO_NONBLOCK on its wakeup socket. Linux has no such option, so it maps
+ * to SO_KEEPALIVE, which any socket accepts; the reactor already passes MSG_DONTWAIT on
+ * every call to that socket.
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <sys/socket.h>
+
+#define SO_BIO           0x10001
+#define SO_HOPCNT        0x10002
+#define SO_MAXMSG        0x10003
+#define SO_MYADDR        0x10004
+#define SO_NBIO          0x10005
+#define SO_NONBLOCK      SO_KEEPALIVE
+#define SO_NOSLOWSTART   0x10007
+#define SO_RUSRBUF       0x10008
+#define SO_RXDATA        0x10009
+#define SO_TCPSACK       0x1000a
+#define SO_TXDATA        0x1000b
+#define SO_WINSCALE      0x1000c
+#define TCP_ACKDELAYTIME 0x1000d
+#define TCP_NOACKDELAY   0x1000e
+
+#endif
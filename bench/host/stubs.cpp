@@ -0,0 +1,49 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+// Host builds: logging goes to stdout.
+
+#include <cstdarg>
+#include <cstdio>
+
+#include <whb/log.h>
+#include <wupsxx/logger.hpp>
+
+
+void
+WHBLogPrintf(const char* fmt, ...)
+{
+    std::va_list args;
+    va_start(args, fmt);
+    std::vprintf(fmt, args);
+    va_end(args);
+    std::putchar('\n');
+}
+
+
+namespace wups::logger {
+
+    int
+    printf(const char* fmt, ...)
+    {
+        std::va_list args;
+        va_start(args, fmt);
+        int result = std::vprintf(fmt, args);
+        va_end(args);
+        return result;
+    }
+
+
+    guard::guard(const char*)
+    {}
+
+
+    guard::~guard()
+    {}
+
+} // namespace wups::logger
@@ -0,0 +1,7 @@
+/* Host builds: the part of WHB's logging the plugin uses, implemented in stubs.cpp. */
+#ifndef WHB_LOG_H
+#define WHB_LOG_H
+
+void WHBLogPrintf(const char* fmt, ...);
+
+#endif
@@ -0,0 +1,16 @@
+/* Host builds: the part of libwupsxx's logger the plugin uses, implemented in stubs.cpp. */
+#ifndef WUPSXX_LOGGER_HPP
+#define WUPSXX_LOGGER_HPP
+
+namespace wups::logger {
+
+    int printf(const char* fmt, ...);
+
+    struct guard {
+        guard(const char* name = nullptr);
+        ~guard();
+    };
+
+} // namespace wups::logger
+
+#endif
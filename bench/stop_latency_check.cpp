@@ -0,0 +1,177 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Host check: a stop request ends a sync that is parked in the reactor within
+ * milliseconds.
+ *
+ * Build and run on the host, from the top directory:
+ *
+ *   g++ -std=c++23 -O2 -pthread -DHAVE_CONFIG_H -Isrc -Ibench/host \
+ *       -include bench/host/host.h \
+ *       bench/stop_latency_check.cpp bench/host/stubs.cpp src/reactor.cpp \
+ *       src/net/address.cpp src/net/error.cpp src/net/io_slots.cpp src/net/socket.cpp \
+ *       -o stop_latency_check
+ *   ./stop_latency_check
+ *
+ * The sync is modeled on ntp::client::process_async(): it waits on a UDP socket that
+ * never gets a reply, with the sync's stop token, and checks the token between waits, like
+ * core::run(). The stop is requested at varying points of the wait. The other cases are
+ * the DNS wait in core::run() (completion_queue::pop_for() with a token), a wait added
+ * while the reactor is already polling, and reactor::stop() with a wait pending.
+ *
+ * Exits with 1 if any stop takes longer than the limit.
+ */
+
+#include <algorithm>            // ranges::max(), ranges::sort()
+#include <chrono>
+#include <cstdio>               // printf()
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include "completion_queue.hpp"
+#include "coro.hpp"
+#include "net/socket.hpp"
+#include "reactor.hpp"
+
+
+using namespace std::literals;
+
+using clock_type = std::chrono::steady_clock;
+
+
+namespace {
+
+    // Before the reactor watched stop tokens, a stop took up to one 100 ms wait. The margin
+    // is for scheduling noise on a loaded host.
+    constexpr auto limit = 50ms;
+
+    bool failed = false;
+
+
+    double
+    ms_since(clock_type::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+    }
+
+
+    void
+    report(const char* name,
+           std::vector<double> latencies)
+    {
+        std::ranges::sort(latencies);
+        double max = std::ranges::max(latencies);
+        bool ok = max < std::chrono::duration<double, std::milli>(limit).count();
+        std::printf("%-30s median %6.2f ms, max %6.2f ms  %s\n",
+                    name,
+                    latencies[latencies.size() / 2],
+                    max,
+                    ok ? "ok" : "FAIL");
+        if (!ok)
+            failed = true;
+    }
+
+
+    coro::task<void>
+    parked_sync(net::socket& sock,
+                std::stop_token token)
+    {
+        while (!token.stop_requested())
+            co_await reactor::readable(sock, 1s, token);
+    }
+
+
+    void
+    check_parked_sync()
+    {
+        auto sock = net::socket::make_udp();
+        sock.bind({ INADDR_LOOPBACK, 0 });
+        std::vector<double> latencies;
+        for (int i = 0; i < 40; ++i) {
+            std::stop_source stopper;
+            auto done = coro::spawn(parked_sync(sock, stopper.get_token()));
+            std::this_thread::sleep_for(std::chrono::milliseconds{37 + 23 * i});
+            auto start = clock_type::now();
+            stopper.request_stop();
+            done.get();
+            latencies.push_back(ms_since(start));
+        }
+        report("sync parked in the reactor:", latencies);
+    }
+
+
+    void
+    check_dns_wait()
+    {
+        std::vector<double> latencies;
+        for (int i = 0; i < 20; ++i) {
+            completion_queue<int> queue;
+            task_promise<int> lookup; // never finishes in time
+            queue.add(lookup.get_future(), 0);
+            std::stop_source stopper;
+            auto delay = std::chrono::milliseconds{37 + 7 * i};
+            auto start = clock_type::now() + delay;
+            std::jthread requester{[&stopper, delay]
+            {
+                std::this_thread::sleep_for(delay);
+                stopper.request_stop();
+            }};
+            while (!stopper.stop_requested())
+                queue.pop_for(1s, stopper.get_token());
+            latencies.push_back(ms_since(start));
+            lookup.set_value(0);
+        }
+        report("DNS wait (pop_for):", latencies);
+    }
+
+
+    coro::task<bool>
+    wait(net::socket& sock,
+         std::chrono::milliseconds timeout)
+    {
+        auto result = co_await reactor::readable(sock, timeout);
+        co_return result && *result;
+    }
+
+
+    void
+    check_new_wait_and_stop()
+    {
+        auto a = net::socket::make_udp();
+        a.bind({ INADDR_LOOPBACK, 0 });
+        auto b = net::socket::make_udp();
+        b.bind({ INADDR_LOOPBACK, 0 });
+
+        auto long_wait = coro::spawn(wait(a, 3s));
+        std::this_thread::sleep_for(50ms);
+
+        auto start = clock_type::now();
+        coro::spawn(wait(b, 50ms)).get();
+        // Only the part after its own 50 ms counts.
+        report("50 ms wait added to a 3 s poll:", { ms_since(start) - 50 });
+
+        start = clock_type::now();
+        reactor::stop();
+        long_wait.get();
+        report("reactor::stop(), 3 s wait:", { ms_since(start) });
+    }
+
+} // namespace
+
+
+int
+main()
+{
+    check_parked_sync();
+    check_dns_wait();
+    check_new_wait_and_stop();
+    reactor::stop();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Host benchmark: memory allocations and latency of thread_pool::submit().
+ *
+ * Build and run on the host, from the top directory:
+ *
+ *   g++ -std=c++23 -O2 -pthread -Isrc bench/thread_pool_bench.cpp src/thread_pool.cpp \
+ *       -o thread_pool_bench
+ *   ./thread_pool_bench
+ *
+ * The reference pool is the previous design: std::bind, std::packaged_task, std::future,
+ * and a mutex queue of std::move_only_function. Both pools get 2 workers, and 20000 tasks
+ * that are submitted, then waited on with get().
+ *
+ * It also checks that submit() doesn't block when the queue is full, and that a task
+ * submitted after a stop fails with broken_promise.
+ */
+
+#include <algorithm>            // ranges::sort()
+#include <atomic>
+#include <chrono>
+#include <cstdio>               // printf()
+#include <cstdlib>              // malloc(), free()
+#include <functional>           // bind(), move_only_function<>
+#include <future>
+#include <new>                  // bad_alloc
+#include <thread>
+#include <vector>
+
+#include "thread_pool.hpp"
+
+
+using namespace std::literals;
+
+using clock_type = std::chrono::steady_clock;
+
+
+namespace {
+
+    std::atomic<unsigned long> allocations = 0;
+
+} // namespace
+
+
+// Note: not inlined, so GCC doesn't pair the malloc() and free() with new and delete.
+[[gnu::noinline]]
+void*
+operator new(std::size_t size)
+{
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc{};
+}
+
+
+[[gnu::noinline]]
+void
+operator delete(void* p)
+    noexcept
+{
+    std::free(p);
+}
+
+
+[[gnu::noinline]]
+void
+operator delete(void* p,
+                std::size_t)
+    noexcept
+{
+    std::free(p);
+}
+
+
+namespace {
+
+    constexpr unsigned num_tasks = 20'000;
+
+
+    class reference_pool {
+
+        std::vector<std::jthread> workers;
+        async_queue<std::move_only_function<void()>> tasks;
+
+    public:
+
+        reference_pool(unsigned num_workers)
+        {
+            for (unsigned i = 0; i < num_workers; ++i)
+                workers.emplace_back([this]
+                {
+                    try {
+                        for (;;)
+                            tasks.pop()();
+                    }
+                    catch (decltype(tasks)::stop_request&) {}
+                });
+        }
+
+
+        ~reference_pool()
+        {
+            tasks.stop();
+        }
+
+
+        template<typename Func, typename... Args>
+        std::future<std::invoke_result_t<std::decay_t<Func>, std::decay_t<Args>...>>
+        submit(Func&& func, Args&&... args)
+        {
+            using Ret = std::invoke_result_t<std::decay_t<Func>, std::decay_t<Args>...>;
+            auto bfunc = std::bind(std::forward<Func>(func), std::forward<Args>(args)...);
+            std::packaged_task<Ret()> task{std::move(bfunc)};
+            auto future = task.get_future();
+            tasks.push(std::move(task));
+            return future;
+        }
+
+    };
+
+
+    template<typename Pool>
+    void
+    measure(const char* name,
+            Pool& pool)
+    {
+        std::vector<double> latencies;
+        latencies.reserve(num_tasks);
+
+        // Warm up: workers started, recycled states filled.
+        for (int i = 0; i < 100; ++i)
+            pool.submit([] { return 0; }).get();
+
+        unsigned long before = allocations;
+        for (unsigned i = 0; i < num_tasks; ++i) {
+            auto start = clock_type::now();
+            pool.submit([](unsigned x) { return x + 1; }, i).get();
+            auto elapsed = clock_type::now() - start;
+            latencies.push_back(std::chrono::duration<double, std::micro>(elapsed).count());
+        }
+        unsigned long allocs = allocations - before;
+
+        std::ranges::sort(latencies);
+        std::printf("%-11s %.2f allocations/task,"
+                    " submit->complete median %.1f us, p99 %.1f us\n",
+                    name,
+                    double(allocs) / num_tasks,
+                    latencies[latencies.size() / 2],
+                    latencies[latencies.size() * 99 / 100]);
+    }
+
+
+    void
+    check_full_queue()
+    {
+        thread_pool pool{1};
+        std::atomic<bool> release = false;
+        auto blocker = pool.submit([&release]
+        {
+            while (!release)
+                std::this_thread::sleep_for(1ms);
+        });
+
+        // More than the queue capacity; the extra ones run on this thread.
+        std::vector<task_future<std::thread::id>> futures;
+        auto start = clock_type::now();
+        for (int i = 0; i < 100; ++i)
+            futures.push_back(pool.submit([] { return std::this_thread::get_id(); }));
+        auto elapsed = clock_type::now() - start;
+        release = true;
+
+        unsigned inline_runs = 0;
+        for (auto& f : futures)
+            inline_runs += f.get() == std::this_thread::get_id();
+        blocker.get();
+        std::printf("full queue: 100 submits took %.1f us, %u ran on the caller\n",
+                    std::chrono::duration<double, std::micro>(elapsed).count(),
+                    inline_runs);
+    }
+
+
+    void
+    check_after_stop()
+    {
+        thread_pool pool{2};
+        pool.submit([] {}).get();
+        auto f = pool.submit([&pool]
+        {
+            std::this_thread::sleep_for(50ms);
+            // Submitted while release_workers() is stopping the pool.
+            return pool.submit([] { return 1; });
+        });
+        std::this_thread::sleep_for(10ms);
+        pool.release_workers();
+        try {
+            f.get().get();
+            std::printf("after stop: the task ran\n");
+        }
+        catch (std::future_error& e) {
+            std::printf("after stop: %s\n", e.what());
+        }
+        std::printf("after release_workers(): %d\n", pool.submit([] { return 42; }).get());
+    }
+
+} // namespace
+
+
+int
+main()
+{
+    {
+        reference_pool pool{2};
+        measure("reference", pool);
+    }
+    {
+        thread_pool pool{2};
+        measure("thread_pool", pool);
+    }
+
+    check_full_queue();
+    check_after_stop();
+}
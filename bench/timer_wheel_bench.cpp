@@ -0,0 +1,159 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Host benchmark: cost of waiting for delayed work, and timer_wheel accuracy.
+ *
+ * Build and run on a Linux host (it reads /proc), from the top directory:
+ *
+ *   g++ -std=c++23 -O2 -pthread -Isrc bench/timer_wheel_bench.cpp src/thread_pool.cpp \
+ *       src/timer_wheel.cpp -o timer_wheel_bench
+ *   ./timer_wheel_bench
+ *
+ * With a sync pending 1 hour away, it counts the threads and their context switches per
+ * second over 5 seconds, for the previous design (a pool worker in a 100 ms sleep loop)
+ * and for the timer wheel. It also reports how late timers fire, and checks that canceled
+ * timers don't fire.
+ */
+
+#include <chrono>
+#include <cstdio>               // printf(), puts()
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.hpp"
+#include "timer_wheel.hpp"
+
+
+using namespace std::literals;
+
+using clock_type = std::chrono::steady_clock;
+
+
+namespace {
+
+    const std::filesystem::path tasks_dir = "/proc/self/task";
+
+
+    long
+    count_threads()
+    {
+        long n = 0;
+        for ([[maybe_unused]] auto& entry : std::filesystem::directory_iterator{tasks_dir})
+            ++n;
+        return n;
+    }
+
+
+    // Voluntary and involuntary context switches of all threads.
+    long
+    count_switches()
+    {
+        long total = 0;
+        for (auto& entry : std::filesystem::directory_iterator{tasks_dir}) {
+            std::ifstream status{entry.path() / "status"};
+            std::string line;
+            while (std::getline(status, line))
+                if (line.starts_with("voluntary_ctxt_switches:")
+                    || line.starts_with("nonvoluntary_ctxt_switches:"))
+                    total += std::stol(line.substr(line.find(':') + 1));
+        }
+        return total;
+    }
+
+
+    void
+    measure_idle(const char* name)
+    {
+        std::this_thread::sleep_for(500ms);
+        long before = count_switches();
+        std::this_thread::sleep_for(5s);
+        // Note: the main thread's own wakeup is not counted.
+        long wakeups = count_switches() - before - 1;
+        std::printf("%-16s threads: main + %ld, wakeups/s: %.1f\n",
+                    name,
+                    count_threads() - 1,
+                    wakeups / 5.0);
+    }
+
+
+    void
+    sleep_loop()
+    {
+        thread_pool pool{1};
+        std::stop_source stopper;
+        pool.submit([](std::stop_token token)
+        {
+            auto deadline = clock_type::now() + 1h;
+            while (clock_type::now() < deadline && !token.stop_requested())
+                std::this_thread::sleep_for(100ms);
+        },
+            stopper.get_token());
+        measure_idle("old sleep loop:");
+        stopper.request_stop();
+    }
+
+
+    void
+    wheel_idle()
+    {
+        thread_pool pool{1};
+        timer_wheel wheel;
+        auto handle = wheel.schedule_after(1h, [&pool] { pool.submit([] {}); });
+        measure_idle("timer wheel:");
+        handle.cancel();
+    }
+
+
+    void
+    accuracy()
+    {
+        timer_wheel wheel;
+        std::mutex mutex;
+        std::vector<std::pair<long, long>> fired; // requested, actual (ms)
+        auto start = clock_type::now();
+        for (long ms : {0L, 5L, 15L, 100L, 640L, 700L, 1300L, 2500L})
+            wheel.schedule_after(std::chrono::milliseconds{ms}, [&, ms]
+            {
+                std::lock_guard guard{mutex};
+                auto elapsed = clock_type::now() - start;
+                fired.push_back({ ms, elapsed / 1ms });
+            });
+        auto canceled = wheel.schedule_after(200ms,
+                                             [] { std::puts("ERROR: canceled timer fired"); });
+        std::this_thread::sleep_for(100ms);
+        bool first = canceled.cancel();
+        bool second = canceled.cancel();
+        std::printf("cancel: %s, cancel again: %s\n",
+                    first ? "true" : "false",
+                    second ? "true" : "false");
+
+        std::this_thread::sleep_for(2600ms);
+        std::lock_guard guard{mutex};
+        for (auto [requested, actual] : fired)
+            std::printf("requested %5ld ms, fired at %5ld ms, late by %ld ms\n",
+                        requested,
+                        actual,
+                        actual - requested);
+    }
+
+} // namespace
+
+
+int
+main()
+{
+    sleep_loop();
+    wheel_idle();
+    accuracy();
+}
@@ -9,18 +9,22 @@
 #ifndef ASYNC_QUEUE_HPP
 #define ASYNC_QUEUE_HPP
 
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>              // size_t
 #include <mutex>
 #include <optional>
 #include <queue>
-#include <utility>              // forward(), move()
+#include <utility>              // forward(), move(), swap()
+
+#include "mpmc_ring.hpp"
 
 
 template<typename T,
          typename Q = std::queue<T>>
 class async_queue {
 
-    std::mutex mutex;
+    mutable std::mutex mutex;
     std::condition_variable empty_cond;
     Q queue;
     bool should_stop = false;
@@ -57,6 +61,19 @@ public:
     }
 
 
+    // Discard all queued items, even after a stop().
+    void
+    clear()
+    {
+        Q old;
+        {
+            std::lock_guard guard{mutex};
+            std::swap(old, queue);
+        }
+        // Note: destroy the items without the lock, they might push more.
+    }
+
+
     bool
     empty()
         const
@@ -120,4 +137,160 @@ public:
 };
 
 
+/*
+ * Specialization for the lock-free ring buffer.
+ *
+ * Threads only park (with atomic wait) when the queue is empty, or, for producers, when
+ * it's full; this is the backpressure for producers that are faster than the consumers.
+ */
+template<typename T,
+         std::size_t N>
+class async_queue<T, mpmc_ring<T, N>> {
+
+    mpmc_ring<T, N> ring;
+
+    // These change after every push/pop, so waiting threads can park on them.
+    std::atomic<unsigned> push_count = 0;
+    std::atomic<unsigned> pop_count = 0;
+
+    // Set by threads about to park; notifications are skipped when nobody is waiting.
+    std::atomic<bool> consumers_waiting = false;
+    std::atomic<bool> producers_waiting = false;
+
+    std::atomic<bool> should_stop = false;
+
+
+    // Park until the counter changes from old.
+    static
+    void
+    park(std::atomic<unsigned>& counter,
+         unsigned old,
+         std::atomic<bool>& waiting)
+    {
+        waiting = true;
+        // Check again, in case the other side didn't see the flag.
+        if (counter.load() == old)
+            counter.wait(old);
+    }
+
+
+    // Only the first signal after threads park needs to wake them up.
+    static
+    void
+    signal(std::atomic<unsigned>& counter,
+           std::atomic<bool>& waiting)
+    {
+        ++counter;
+        if (waiting.load() && waiting.exchange(false))
+            counter.notify_all();
+    }
+
+public:
+
+    struct stop_request {};
+
+    // Makes the pool usable again after a stop().
+    void
+    reset()
+    {
+        should_stop = false;
+    }
+
+
+    // This will make all future pop() calls throw a stop_request{}, as well as push()
+    // calls that would block. It also wakes up all waiting threads.
+    void
+    stop()
+    {
+        should_stop = true;
+        ++push_count;
+        push_count.notify_all();
+        ++pop_count;
+        pop_count.notify_all();
+    }
+
+
+    bool
+    is_stopping()
+        const
+    {
+        return should_stop;
+    }
+
+
+    // Discard all queued items, even after a stop().
+    void
+    clear()
+    {
+        while (ring.try_pop())
+            signal(pop_count, producers_waiting);
+    }
+
+
+    bool
+    empty()
+        const
+    {
+        return ring.empty();
+    }
+
+
+    template<typename U>
+    void
+    push(U&& x)
+    {
+        T item(std::forward<U>(x));
+        for (;;) {
+            unsigned pops = pop_count.load();
+            if (ring.try_push(std::move(item)))
+                break;
+            if (should_stop)
+                throw stop_request{}; // nobody will make room
+            park(pop_count, pops, producers_waiting);
+        }
+        signal(push_count, consumers_waiting);
+    }
+
+
+    T
+    pop()
+    {
+        for (;;) {
+            unsigned pushes = push_count.load();
+            if (should_stop)
+                throw stop_request{};
+            if (auto result = ring.try_pop()) {
+                signal(pop_count, producers_waiting);
+                return std::move(*result);
+            }
+            park(push_count, pushes, consumers_waiting);
+        }
+    }
+
+
+    // Returns false if full, without waiting; x is only moved from on success.
+    bool
+    try_push(T&& x)
+    {
+        if (!ring.try_push(std::move(x)))
+            return false;
+        signal(push_count, consumers_waiting);
+        return true;
+    }
+
+
+    std::optional<T>
+    try_pop()
+    {
+        if (should_stop)
+            throw stop_request{};
+        auto result = ring.try_pop();
+        if (result)
+            signal(pop_count, producers_waiting);
+        return result;
+    }
+
+};
+
+
 #endif
@@ -46,11 +46,19 @@ namespace cfg {
 
     namespace keys {
         const char* auto_tz         = "auto_tz";
+        const char* burst_interval  = "burst_interval";
+        const char* burst_size      = "burst_size";
+        const char* hedge_budget    = "hedge_budget";
         const char* msg_duration    = "msg_duration";
         const char* notify          = "notify";
+        const char* quorum          = "quorum";
+        const char* quorum_bound    = "quorum_bound";
         const char* server          = "server";
+        const char* slew_threshold  = "slew_threshold";
+        const char* slew_window     = "slew_window";
         const char* sync_on_boot    = "sync_on_boot";
         const char* sync_on_changes = "sync_on_changes";
+        const char* sync_periodic   = "sync_periodic";
         const char* threads         = "threads";
         const char* timeout         = "timeout";
         const char* tolerance       = "tolerance";
@@ -61,11 +69,19 @@ namespace cfg {
 
     namespace labels {
         const char* auto_tz         = "   └ Auto update time zone";
+        const char* burst_interval  = " └ Burst interval";
+        const char* burst_size      = "Requests per server";
+        const char* hedge_budget    = "Extra servers for late replies";
         const char* msg_duration    = " └ Notification duration";
         const char* notify          = "Show notifications";
+        const char* quorum          = "Quorum";
+        const char* quorum_bound    = " └ Quorum agreement";
         const char* server          = "NTP servers";
+        const char* slew_threshold  = "Slew corrections below";
+        const char* slew_window     = " └ Slew duration";
         const char* sync_on_boot    = "Synchronize on boot";
         const char* sync_on_changes = "Synchronize after changing configuration";
+        const char* sync_periodic   = "Synchronize periodically";
         const char* threads         = "Background threads";
         const char* timeout         = "Timeout";
         const char* tolerance       = "Tolerance";
@@ -76,11 +92,19 @@ namespace cfg {
 
     namespace defaults {
         const bool         auto_tz         = false;
+        const milliseconds burst_interval  = 1000ms;
+        const int          burst_size      = 1;
+        const int          hedge_budget    = 2;
         const seconds      msg_duration    = 5s;
         const int          notify          = 1;
+        const int          quorum          = 0;
+        const milliseconds quorum_bound    = 100ms;
         const std::string  server          = "pool.ntp.org";
+        const milliseconds slew_threshold  = 0ms;
+        const seconds      slew_window     = 60s;
         const bool         sync_on_boot    = false;
         const bool         sync_on_changes = true;
+        const bool         sync_periodic   = false;
         const int          threads         = 4;
         const seconds      timeout         = 5s;
         const milliseconds tolerance       = 500ms;
@@ -90,11 +114,19 @@ namespace cfg {
 
 
     bool         auto_tz         = defaults::auto_tz;
+    milliseconds burst_interval  = defaults::burst_interval;
+    int          burst_size      = defaults::burst_size;
+    int          hedge_budget    = defaults::hedge_budget;
     seconds      msg_duration    = defaults::msg_duration;
     int          notify          = defaults::notify;
+    int          quorum          = defaults::quorum;
+    milliseconds quorum_bound    = defaults::quorum_bound;
     std::string  server          = defaults::server;
+    milliseconds slew_threshold  = defaults::slew_threshold;
+    seconds      slew_window     = defaults::slew_window;
     bool         sync_on_boot    = defaults::sync_on_boot;
     bool         sync_on_changes = defaults::sync_on_changes;
+    bool         sync_periodic   = defaults::sync_periodic;
     int          threads         = defaults::threads;
     seconds      timeout         = defaults::timeout;
     milliseconds tolerance       = defaults::tolerance;
@@ -105,6 +137,7 @@ namespace cfg {
     // variables that, if changed, may affect the sync
     namespace previous {
         bool         auto_tz;
+        bool         sync_periodic;
         milliseconds tolerance;
         int          tz_service;
         minutes      utc_offset;
@@ -115,6 +148,7 @@ namespace cfg {
     save_important_vars()
     {
         previous::auto_tz = auto_tz;
+        previous::sync_periodic = sync_periodic;
         previous::tolerance = tolerance;
         previous::tz_service = tz_service;
         previous::utc_offset = utc_offset;
@@ -146,6 +180,11 @@ namespace cfg {
                                   cfg::defaults::sync_on_changes,
                                   "on", "off"));
 
+        cat.add(bool_item::create(cfg::labels::sync_periodic,
+                                  cfg::sync_periodic,
+                                  cfg::defaults::sync_periodic,
+                                  "on", "off"));
+
         cat.add(verbosity_item::create(cfg::labels::notify,
                                        cfg::notify,
                                        cfg::defaults::notify));
@@ -173,11 +212,46 @@ namespace cfg {
                                      cfg::defaults::timeout,
                                      1s, 10s, 5s));
 
+        cat.add(int_item::create(cfg::labels::burst_size,
+                                 cfg::burst_size,
+                                 cfg::defaults::burst_size,
+                                 1, 8, 2));
+
+        cat.add(milliseconds_item::create(cfg::labels::burst_interval,
+                                          cfg::burst_interval,
+                                          cfg::defaults::burst_interval,
+                                          100ms, 2000ms, 100ms));
+
+        cat.add(int_item::create(cfg::labels::quorum,
+                                 cfg::quorum,
+                                 cfg::defaults::quorum,
+                                 0, 8, 1));
+
+        cat.add(milliseconds_item::create(cfg::labels::quorum_bound,
+                                          cfg::quorum_bound,
+                                          cfg::defaults::quorum_bound,
+                                          10ms, 1000ms, 10ms));
+
+        cat.add(int_item::create(cfg::labels::hedge_budget,
+                                 cfg::hedge_budget,
+                                 cfg::defaults::hedge_budget,
+                                 0, 8, 1));
+
         cat.add(milliseconds_item::create(cfg::labels::tolerance,
                                           cfg::tolerance,
                                           cfg::defaults::tolerance,
                                           0ms, 5000ms, 100ms));
 
+        cat.add(milliseconds_item::create(cfg::labels::slew_threshold,
+                                          cfg::slew_threshold,
+                                          cfg::defaults::slew_threshold,
+                                          0ms, 5000ms, 100ms));
+
+        cat.add(seconds_item::create(cfg::labels::slew_window,
+                                     cfg::slew_window,
+                                     cfg::defaults::slew_window,
+                                     10s, 600s, 10s));
+
         cat.add(int_item::create(cfg::labels::threads,
                                  cfg::threads,
                                  cfg::defaults::threads,
@@ -212,6 +286,11 @@ namespace cfg {
         if (cfg::sync_on_changes && important_vars_changed()) {
             core::background::stop();
             core::background::run();
+        } else if (previous::sync_periodic != sync_periodic) {
+            // Start or stop the periodic sync, without syncing right away.
+            core::background::stop();
+            if (sync_periodic)
+                core::background::run_once();
         }
 
         cfg::save();
@@ -245,11 +324,19 @@ namespace cfg {
         try {
 #define LOAD(x) wups::storage::load_or_init(keys::x, x, defaults::x)
             LOAD(auto_tz);
+            LOAD(burst_interval);
+            LOAD(burst_size);
+            LOAD(hedge_budget);
             LOAD(msg_duration);
             LOAD(notify);
+            LOAD(quorum);
+            LOAD(quorum_bound);
             LOAD(server);
+            LOAD(slew_threshold);
+            LOAD(slew_window);
             LOAD(sync_on_boot);
             LOAD(sync_on_changes);
+            LOAD(sync_periodic);
             LOAD(threads);
             LOAD(timeout);
             LOAD(tolerance);
@@ -282,11 +369,19 @@ namespace cfg {
         try {
 #define STORE(x) wups::storage::store(keys::x, x)
             STORE(auto_tz);
+            STORE(burst_interval);
+            STORE(burst_size);
+            STORE(hedge_budget);
             STORE(msg_duration);
             STORE(notify);
+            STORE(quorum);
+            STORE(quorum_bound);
             STORE(server);
+            STORE(slew_threshold);
+            STORE(slew_window);
             STORE(sync_on_boot);
             STORE(sync_on_changes);
+            STORE(sync_periodic);
             STORE(threads);
             STORE(timeout);
             STORE(tolerance);
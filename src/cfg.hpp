@@ -17,11 +17,19 @@
 namespace cfg {
 
     extern bool                      auto_tz;
+    extern std::chrono::milliseconds burst_interval;
+    extern int                       burst_size;
+    extern int                       hedge_budget;
     extern std::chrono::seconds      msg_duration;
     extern int                       notify;
+    extern int                       quorum;
+    extern std::chrono::milliseconds quorum_bound;
     extern std::string               server;
+    extern std::chrono::milliseconds slew_threshold;
+    extern std::chrono::seconds      slew_window;
     extern bool                      sync_on_boot;
     extern bool                      sync_on_changes;
+    extern bool                      sync_periodic;
     extern int                       threads;
     extern std::chrono::seconds      timeout;
     extern std::chrono::milliseconds tolerance;
@@ -8,7 +8,9 @@
  */
 
 #include <cmath>                // max(), min()
+#include <cstddef>              // size_t
 #include <exception>
+#include <map>
 #include <vector>
 
 #include <wupsxx/cafe_glyphs.h>
@@ -17,8 +19,10 @@
 #include "clock_item.hpp"
 
 #include "cfg.hpp"
+#include "completion_queue.hpp"
 #include "core.hpp"
-#include "net/addrinfo.hpp"
+#include "ntp_select.hpp"
+#include "scorecard.hpp"
 #include "time_utils.hpp"
 #include "utils.hpp"
 
@@ -102,7 +106,8 @@ clock_item::update_status_msg()
 
 
 /*
- * Note: this code is very similar to core::run(), but runs in a single thread.
+ * Note: this code is very similar to core::run(), but results are shown for each server,
+ * and no early stop is done.
  */
 void
 clock_item::run()
@@ -120,67 +125,124 @@ clock_item::run()
 
     auto servers = utils::split(cfg::server, " \t,;");
 
-    net::addrinfo::hints opts{ .type = net::socket::type::udp };
+    struct server_results {
+        bool resolved = false;
+        std::vector<dbl_seconds> corrections;
+        std::vector<dbl_seconds> latencies;
+        unsigned errors = 0;
+    };
+    std::vector<server_results> results(servers.size());
+
+    // Resolve all names at once; each lookup is tagged with the server's index.
+    completion_queue<std::vector<net::address>> lookups;
+    for (std::size_t i = 0; i < servers.size(); ++i)
+        lookups.add(core::resolve(servers[i]), i);
 
-    dbl_seconds total = 0s;
-    unsigned num_values = 0;
+    // Query all addresses from a single socket, as soon as they're known, except the ones
+    // that asked us to back off.
+    ntp::client client{core::get_ntp_options()};
+    std::map<net::address, std::size_t> owners;
 
-    for (const auto& server : servers) {
+    auto handle_lookup = [&](completion_queue<std::vector<net::address>>::completion& done)
+    {
+        const std::string& server = servers[done.tag];
         auto& si = server_infos.at(server);
         try {
-            auto infos = net::addrinfo::lookup(server, "123", opts);
-
-            si.name->text = to_string(infos.size())
-                + (infos.size() > 1 ? " addresses."s : " address."s);
-
-            std::vector<dbl_seconds> server_corrections;
-            std::vector<dbl_seconds> server_latencies;
-            unsigned errors = 0;
-
-            for (const auto& info : infos) {
-                try {
-                    auto [correction, latency] = core::ntp_query({}, info.addr);
-                    server_corrections.push_back(correction);
-                    server_latencies.push_back(latency);
-                    total += correction;
-                    ++num_values;
-                    logger::printf("%s (%s): correction = %s, latency = %s\n",
+            auto addresses = done.result.get();
+            results[done.tag].resolved = true;
+
+            si.name->text = to_string(addresses.size())
+                + (addresses.size() > 1 ? " addresses."s : " address."s);
+
+            unsigned backed_off = 0;
+            for (auto address : addresses) {
+                if (scorecard::backoff_left(address)) {
+                    ++backed_off;
+                    logger::printf("%s (%s): skipped, server asked to back off (%s).\n",
                                    server.c_str(),
-                                   to_string(info.addr).c_str(),
-                                   seconds_to_human(correction, true).c_str(),
-                                   seconds_to_human(latency).c_str());
-                }
-                catch (std::exception& e) {
-                    ++errors;
-                    logger::printf("Error: %s\n", e.what());
+                                   to_string(address).c_str(),
+                                   scorecard::backoff_reason(address).c_str());
+                    continue;
                 }
+                // Note: an address shared by two names is only queried once.
+                if (owners.try_emplace(address, done.tag).second)
+                    client.add(address, scorecard::retransmit_timeout(address));
             }
+            if (backed_off)
+                si.name->text += " "s + to_string(backed_off) + " skipped (Kiss-o'-Death).";
+        }
+        catch (std::exception& e) {
+            si.name->text = e.what();
+        }
+    };
+
+    std::vector<ntp::candidate> candidates;
+
+    while (!lookups.empty() || !client.empty()) {
+        // Handle the names in the order they were resolved.
+        while (auto done = lookups.try_pop())
+            handle_lookup(*done);
+
+        if (client.empty()) {
+            if (auto done = lookups.pop_for(100ms))
+                handle_lookup(*done);
+            continue;
+        }
 
-            if (errors)
-                si.name->text += " "s + to_string(errors)
-                    + (errors > 1 ? " errors."s : " error."s);
-            if (!server_corrections.empty()) {
-                auto corr_stats = get_statistics(server_corrections);
-                si.correction->text = "min = "s + seconds_to_human(corr_stats.min, true)
-                    + ", max = "s + seconds_to_human(corr_stats.max, true)
-                    + ", avg = "s + seconds_to_human(corr_stats.avg, true);
-                auto late_stats = get_statistics(server_latencies);
-                si.latency->text = "min = "s + seconds_to_human(late_stats.min)
-                    + ", max = "s + seconds_to_human(late_stats.max)
-                    + ", avg = "s + seconds_to_human(late_stats.avg);
+        // While names are being resolved, don't wait too long for NTP replies.
+        for (auto& [address, value, kiss_code] : client.process(lookups.empty() ? 100ms : 10ms)) {
+            std::size_t index = owners.at(address);
+            const std::string& server = servers[index];
+            auto& r = results[index];
+            if (!kiss_code.empty())
+                scorecard::record_kod(address, kiss_code);
+            if (value) {
+                r.corrections.push_back(value->correction);
+                r.latencies.push_back(value->latency);
+                candidates.push_back({ value->correction, ntp::root_distance(*value) });
+                logger::printf("%s (%s): correction = %s, latency = %s, jitter = %s\n",
+                               server.c_str(),
+                               to_string(address).c_str(),
+                               seconds_to_human(value->correction, true).c_str(),
+                               seconds_to_human(value->latency).c_str(),
+                               seconds_to_human(value->jitter).c_str());
             } else {
-                si.correction->text = "No data.";
-                si.latency->text = "No data.";
+                ++r.errors;
+                logger::printf("Error: %s\n", value.error().c_str());
             }
         }
-        catch (std::exception& e) {
-            si.name->text = e.what();
+    }
+
+    for (std::size_t i = 0; i < servers.size(); ++i) {
+        const auto& r = results[i];
+        if (!r.resolved)
+            continue;
+        auto& si = server_infos.at(servers[i]);
+        if (r.errors)
+            si.name->text += " "s + to_string(r.errors)
+                + (r.errors > 1 ? " errors."s : " error."s);
+        if (!r.corrections.empty()) {
+            auto corr_stats = get_statistics(r.corrections);
+            si.correction->text = "min = "s + seconds_to_human(corr_stats.min, true)
+                + ", max = "s + seconds_to_human(corr_stats.max, true)
+                + ", avg = "s + seconds_to_human(corr_stats.avg, true);
+            auto late_stats = get_statistics(r.latencies);
+            si.latency->text = "min = "s + seconds_to_human(late_stats.min)
+                + ", max = "s + seconds_to_human(late_stats.max)
+                + ", avg = "s + seconds_to_human(late_stats.avg);
+        } else {
+            si.correction->text = "No data.";
+            si.latency->text = "No data.";
         }
     }
 
-    if (num_values) {
-        dbl_seconds avg = total / num_values;
-        diff_str = ", needs "s + seconds_to_human(avg, true);
+    scorecard::save();
+
+    auto sel = ntp::select(candidates);
+    if (sel) {
+        auto [correction, error] = ntp::combine(candidates, *sel);
+        diff_str = ", needs "s + seconds_to_human(correction, true)
+            + " ± "s + seconds_to_human(error);
     } else
         diff_str = "";
 }
@@ -0,0 +1,125 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef COMPLETION_QUEUE_HPP
+#define COMPLETION_QUEUE_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>              // size_t
+#include <deque>
+#include <memory>               // make_shared(), shared_ptr<>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <utility>              // move()
+
+#include "task_future.hpp"
+
+
+/*
+ * Collects futures as they become ready, so results can be handled in the order they
+ * finish, not in the order they were submitted.
+ *
+ * Each future is added with a tag, to identify it when it comes out of the queue.
+ */
+template<typename T,
+         typename Tag = std::size_t>
+class completion_queue {
+
+public:
+
+    struct completion {
+        Tag tag;
+        task_future<T> result; // always ready
+    };
+
+private:
+
+    // Note: shared with the continuations, so the queue can be destroyed while futures
+    // are still pending.
+    struct shared_data {
+        std::mutex mutex;
+        std::condition_variable_any cond;
+        std::deque<completion> done;
+        std::size_t pending = 0;
+    };
+
+    std::shared_ptr<shared_data> data = std::make_shared<shared_data>();
+
+public:
+
+    void
+    add(task_future<T> future,
+        Tag tag)
+    {
+        {
+            std::lock_guard guard{data->mutex};
+            ++data->pending;
+        }
+        std::move(future).then([data = data, tag](task_future<T> result)
+        {
+            {
+                std::lock_guard guard{data->mutex};
+                --data->pending;
+                data->done.push_back({ tag, std::move(result) });
+            }
+            data->cond.notify_one();
+        });
+    }
+
+
+    // How many futures were added, but not popped yet.
+    std::size_t
+    size()
+        const
+    {
+        std::lock_guard guard{data->mutex};
+        return data->pending + data->done.size();
+    }
+
+
+    bool
+    empty()
+        const
+    {
+        return size() == 0;
+    }
+
+
+    std::optional<completion>
+    try_pop()
+    {
+        std::lock_guard guard{data->mutex};
+        if (data->done.empty())
+            return {};
+        completion result = std::move(data->done.front());
+        data->done.pop_front();
+        return result;
+    }
+
+
+    // Wait for the next future to be ready; empty if the timeout was reached first, or a
+    // stop was requested through the token.
+    template<typename Rep,
+             typename Period>
+    std::optional<completion>
+    pop_for(const std::chrono::duration<Rep, Period>& timeout,
+            std::stop_token token = {})
+    {
+        std::unique_lock guard{data->mutex};
+        if (!data->cond.wait_for(guard, token, timeout, [this] { return !data->done.empty(); }))
+            return {};
+        completion result = std::move(data->done.front());
+        data->done.pop_front();
+        return result;
+    }
+
+};
+
+#endif
@@ -7,15 +7,19 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <algorithm>            // clamp(), max(), min()
 #include <atomic>
+#include <cmath>                // abs()
 #include <chrono>
+#include <condition_variable>
 #include <cstdio>               // snprintf()
-#include <numeric>              // accumulate()
-#include <ranges>               // views::zip()
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <set>
 #include <stdexcept>            // runtime_error
 #include <string>
-#include <thread>
 #include <vector>
 
 #include <coreinit/time.h>
@@ -27,10 +31,19 @@
 #include "core.hpp"
 
 #include "cfg.hpp"
-#include "net/addrinfo.hpp"
+#include "completion_queue.hpp"
+#include "dns_cache.hpp"
+#include "drift.hpp"
+#include "executor.hpp"
+#include "net/error.hpp"
+#include "net/io_slots.hpp"
 #include "net/socket.hpp"
 #include "notify.hpp"
 #include "ntp.hpp"
+#include "ntp_client.hpp"
+#include "ntp_select.hpp"
+#include "scorecard.hpp"
+#include "slew.hpp"
 #include "thread_pool.hpp"
 #include "time_utils.hpp"
 #include "utc.hpp"
@@ -51,28 +64,6 @@ using time_utils::dbl_seconds;
 
 namespace {
 
-    // Difference from NTP (1900) to Wii U (2000) epochs.
-    // There are 24 leap years in this period.
-    constexpr dbl_seconds seconds_per_day{24 * 60 * 60};
-    constexpr dbl_seconds epoch_diff = seconds_per_day * (100 * 365 + 24);
-
-
-    // Wii U -> NTP epoch.
-    ntp::timestamp
-    to_ntp(utc::timestamp t)
-    {
-        return ntp::timestamp{t.value + epoch_diff};
-    }
-
-
-    // NTP -> Wii U epoch.
-    utc::timestamp
-    to_utc(ntp::timestamp t)
-    {
-        return utc::timestamp{static_cast<dbl_seconds>(t) - epoch_diff};
-    }
-
-
     std::string
     ticks_to_string(OSTime wt)
     {
@@ -85,16 +76,6 @@ namespace {
                       cal.tm_hour, cal.tm_min, cal.tm_sec, cal.tm_msec);
         return buffer;
     }
-
-
-    std::string
-    to_string(ntp::timestamp t)
-    {
-        auto ut = to_utc(t);
-        OSTime ticks = ut.value.count() * OSTimerClockSpeed;
-        return ticks_to_string(ticks);
-    }
-
 } // namespace
 
 
@@ -106,6 +87,12 @@ namespace core {
     };
 
 
+    // The network could not be used at all; other errors mean it was reachable.
+    struct network_error : runtime_error {
+        using runtime_error::runtime_error;
+    };
+
+
     void
     check_stop(std::stop_token token)
     {
@@ -114,168 +101,36 @@ namespace core {
     }
 
 
-    void
-    sleep_for(std::chrono::milliseconds t,
-              std::stop_token token)
+    task_future<std::vector<net::address>>
+    resolve(const std::string& name)
     {
-        using clock = std::chrono::steady_clock;
-        const auto deadline = clock::now() + t;
-        while (clock::now() < deadline) {
-            check_stop(token);
-            std::this_thread::sleep_for(100ms);
+        if (cfg::threads <= 0) {
+            // No background threads, the lookup is done right here. But a stale entry can
+            // be used right away, refreshing it must not delay the sync.
+            static thread_pool inline_pool{0};
+            return dns_cache::resolve(name, "123", inline_pool, executor::get());
         }
+        return dns_cache::resolve(name, "123", executor::get(), executor::get());
     }
 
 
-    // Note: hardcoded for IPv4, the Wii U doesn't have IPv6.
-    std::pair<dbl_seconds, dbl_seconds>
-    ntp_query(std::stop_token token,
-              net::address address)
+    ntp::client::options
+    get_ntp_options()
     {
-        using std::to_string;
-
-        net::socket sock{net::socket::type::udp};
-        sock.connect(address);
-
-        ntp::packet packet;
-        packet.version(4);
-        packet.mode(ntp::packet::mode_flag::client);
-
-
-        unsigned send_attempts = 0;
-        const unsigned max_send_attempts = 4;
-
-    try_again_send:
-        // cancellation point: before sending
-        check_stop(token);
-        auto t1 = to_ntp(utc::now());
-        packet.transmit_time = t1;
-
-        auto send_status = sock.try_send(&packet, sizeof packet);
-        if (!send_status) {
-            auto& e = send_status.error();
-            if (e.code() != std::errc::not_enough_memory)
-                throw e;
-            if (++send_attempts < max_send_attempts) {
-                // cancellation point: before sleeping
-                check_stop(token);
-                std::this_thread::sleep_for(100ms);
-                goto try_again_send;
-            } else
-                throw runtime_error{"No resources for send(), too many retries!"};
-        }
-
-
-        unsigned poll_attempts = 0;
-        const unsigned max_poll_attempts = 4;
-
-    try_again_poll:
-        // cancellation point: before polling
-        check_stop(token);
-        auto readable_status = sock.try_is_readable(cfg::timeout);
-        if (!readable_status) {
-            // Wii U OS can only handle 16 concurrent select()/poll() calls,
-            // so we may need to try again later.
-            auto& e = readable_status.error();
-            if (e.code() != std::errc::not_enough_memory)
-                throw e;
-            if (++poll_attempts < max_poll_attempts) {
-                // cancellation point: before sleeping
-                check_stop(token);
-                std::this_thread::sleep_for(10ms);
-                goto try_again_poll;
-            } else
-                throw runtime_error{"No resources for poll(), too many retries!"};
-        }
-
-        if (!*readable_status)
-            throw runtime_error{"Timeout reached!"};
-
-        // Measure the arrival time as soon as possible.
-        auto t4 = to_ntp(utc::now());
-
-        if (sock.recv(&packet, sizeof packet) < 48)
-            throw runtime_error{"Invalid NTP response!"};
-
-        sock.close(); // close it early
-
-        auto v = packet.version();
-        if (v < 3 || v > 4)
-            throw runtime_error{"Unsupported NTP version: "s + to_string(v)};
-
-        auto m = packet.mode();
-        if (m != ntp::packet::mode_flag::server)
-            throw runtime_error{"Invalid NTP packet mode: "s + to_string(m)};
-
-        auto l = packet.leap();
-        if (l == ntp::packet::leap_flag::unknown)
-            throw runtime_error{"Unknown value for leap flag."};
-
-        ntp::timestamp t1_received = packet.origin_time;
-        if (t1 != t1_received)
-            throw runtime_error{"NTP response mismatch: ["s
-                                + ::to_string(t1) + "] vs ["s
-                                + ::to_string(t1_received) + "]"s};
-
-        // when our request arrived at the server
-        auto t2 = packet.receive_time;
-        // when the server sent out a response
-        auto t3 = packet.transmit_time;
-
-        // Zero is not a valid timestamp.
-        if (!t2 || !t3)
-            throw runtime_error{"NTP response has invalid timestamps."};
-
-        /*
-         * We do all calculations in double precision to never worry about overflows. Since
-         * double precision has 53 mantissa bits, we're guaranteed to have 53 - 32 = 21
-         * fractional bits in Era 0, and 20 fractional bits in Era 1 (starting in 2036). We
-         * still have sub-microsecond resolution.
-         */
-        auto d1 = static_cast<dbl_seconds>(t1);
-        auto d2 = static_cast<dbl_seconds>(t2);
-        auto d3 = static_cast<dbl_seconds>(t3);
-        auto d4 = static_cast<dbl_seconds>(t4);
-
-        // Detect the wraparound that will happen at the end of Era 0.
-        constexpr dbl_seconds half_era{0x1.0p32};     // 2^32 seconds
-        constexpr dbl_seconds quarter_era{0x1.0p31};  // 2^31 seconds
-        if (d4 < d1)
-            d4 += half_era; // d4 += 2^32
-        if (d3 < d2)
-            d3 += half_era; // d3 += 2^32
-
-        dbl_seconds roundtrip = (d4 - d1) - (d3 - d2);
-        dbl_seconds latency = roundtrip / 2.0;
-
-        // t4 + correction = t3 + latency
-        dbl_seconds correction = d3 + latency - d4;
-
-        /*
-         * If the local clock enters Era 1 ahead of NTP, we get a massive positive correction
-         * because the local clock wrapped back to zero.
-         */
-        if (correction > quarter_era) // if correcting more than 68 years forward
-            correction -= half_era;
-
-        /*
-         * If NTP enters Era 1 ahead of the local clock, we get a massive negative correction
-         * because NTP wrapped back to zero.
-         */
-        if (correction < -quarter_era) // if correcting more than 68 years backward
-            correction += half_era;
-
-        return { correction, latency };
+        return {
+            .timeout = cfg::timeout,
+            .burst_size = static_cast<unsigned>(cfg::burst_size),
+            .burst_interval = cfg::burst_interval,
+        };
     }
 
 
-
     bool
-    apply_clock_correction(dbl_seconds seconds)
+    apply_clock_correction(ntp::fixed_seconds correction)
     {
         // OSTime before = OSGetSystemTime();
 
-        OSTime ticks = seconds.count() * OSTimerClockSpeed;
+        OSTime ticks = utc::to_ticks(correction);
 
         nn::pdm::NotifySetTimeBeginEvent();
 
@@ -302,13 +157,59 @@ namespace core {
     }
 
 
+    // The unapplied part of a slew is clock error the drift model must not count.
     void
+    cancel_slew()
+    {
+        if (auto left = slew::cancel(); left != 0s)
+            drift::record_holdover(-left);
+    }
+
+
+    // Slew the clock if the correction is small enough, otherwise step it.
+    // Returns true if slewing.
+    bool
+    correct_clock(dbl_seconds correction)
+    {
+        if (abs(correction) < cfg::slew_threshold) {
+            if (auto left = slew::start(correction, cfg::slew_window); left != 0s)
+                drift::record_holdover(-left);
+            return true;
+        }
+
+        cancel_slew();
+        if (!apply_clock_correction(std::chrono::duration_cast<ntp::fixed_seconds>(correction)))
+            throw runtime_error{"Failed to set system clock!"};
+        return false;
+    }
+
+
+    std::string
+    correction_message(dbl_seconds correction,
+                       bool slewing)
+    {
+        using time_utils::seconds_to_human;
+
+        if (slewing)
+            return "Slewing clock by " + seconds_to_human(correction, true)
+                + " over " + seconds_to_human(cfg::slew_window);
+        return "Clock corrected by " + seconds_to_human(correction, true);
+    }
+
+
+    report
     run(std::stop_token token,
         bool silent)
     {
         using time_utils::seconds_to_human;
 
-        utils::network_guard net_guard;
+        std::optional<utils::network_guard> net_guard;
+        try {
+            net_guard.emplace();
+        }
+        catch (std::exception& e) {
+            throw network_error{e.what()};
+        }
 
         // ensure notification is initialized if needed
         notify::guard notify_guard{cfg::notify > 0};
@@ -342,106 +243,296 @@ namespace core {
         // cancellation point: after the time zone update
         check_stop(token);
 
-        thread_pool pool{static_cast<unsigned>(cfg::threads)};
-
         std::vector<std::string> servers = utils::split(cfg::server, " \t,;");
+        std::size_t next_server = 0;
+        const std::size_t max_lookups = std::clamp<std::size_t>(cfg::threads,
+                                                                1, net::io_slots::capacity);
+
+        // Each lookup is tagged with the server's index.
+        completion_queue<std::vector<net::address>> lookups;
+
+        // Send all NTP queries from a single socket, and collect replies as they arrive. The
+        // addresses of each name are queried as soon as it's resolved.
+        ntp::client client{get_ntp_options()};
 
-        // First, resolve all the names, in parallel.
         // Some IP addresses might be duplicated when we use "pool.ntp.org".
-        std::set<net::address> addresses;
+        std::set<net::address> seen;
+        std::size_t skipped = 0;
+
+        // Addresses that were not queried, to replace the ones that are late: the good ones
+        // first, best first, then the ones that keep failing.
+        std::deque<net::address> spares;
+        std::size_t good_spares = 0;
+        int hedges_left = cfg::hedge_budget;
+
+        // Each member of a hedged pair maps to the other one. Only the first reply is used.
+        std::map<net::address, net::address> partners;
+        // Members whose partner replied first, but whose results were already returned.
+        std::set<net::address> superseded;
+
+        // Query the addresses of a resolved name.
+        auto handle_lookup = [&](completion_queue<std::vector<net::address>>::completion& done)
         {
-            // nested scope so the futures vector is destroyed
-            using info_vec = std::vector<net::addrinfo::result>;
-            std::vector<std::future<info_vec>> futures(servers.size());
-
-            net::addrinfo::hints opts{ .type = net::socket::type::udp };
-            // Launch DNS queries asynchronously.
-            for (auto [fut, server] : std::views::zip(futures, servers))
-                fut = pool.submit(net::addrinfo::lookup, server, "123"s, opts);
+            try {
+                std::set<net::address> fresh;
+                for (auto addr : done.result.get())
+                    if (seen.insert(addr).second)
+                        fresh.insert(addr);
+                // Query the best addresses first, and skip the ones that keep failing.
+                auto [chosen, extra, fallbacks, backed_off] = scorecard::rank(fresh);
+                skipped += fresh.size() - chosen.size();
+                if (!silent)
+                    for (auto address : backed_off)
+                        notify::info(notify::level::verbose,
+                                     to_string(address) + ": skipped, server asked to back off ("
+                                     + scorecard::backoff_reason(address) + ").");
+                for (auto address : chosen)
+                    client.add(address, scorecard::retransmit_timeout(address));
+                spares.insert(spares.begin() + good_spares, extra.begin(), extra.end());
+                good_spares += extra.size();
+                spares.insert(spares.end(), fallbacks.begin(), fallbacks.end());
+            }
+            catch (std::exception& e) {
+                if (!silent)
+                    notify::error(notify::level::verbose,
+                                  servers[done.tag] + ": " + e.what());
+            }
+        };
 
-            // cancellation point: after submitting the DNS queries
+        std::vector<net::address> replied;
+        std::vector<ntp::candidate> candidates;
+        std::vector<int> poll_exps;
+        while (next_server < servers.size() || !lookups.empty() || !client.empty()) {
+            // cancellation point: before waiting for more DNS results or NTP replies
             check_stop(token);
 
-            // Collect all future results.
-            for (auto& fut : futures)
-                try {
-                    for (auto info : fut.get())
-                        addresses.insert(info.addr);
+            // Launch DNS queries asynchronously; cached names don't need to wait.
+            while (next_server < servers.size() && lookups.size() < max_lookups) {
+                lookups.add(resolve(servers[next_server]), next_server);
+                ++next_server;
+            }
+
+            // Handle the names in the order they were resolved.
+            while (auto done = lookups.try_pop())
+                handle_lookup(*done);
+
+            if (client.empty()) {
+                // Nothing to do until another name is resolved.
+                if (auto done = lookups.pop_for(100ms, token))
+                    handle_lookup(*done);
+                continue;
+            }
+
+            // While names are being resolved, don't wait too long for NTP replies.
+            // Note: this parks the thread running the sync, see ntp::client::process().
+            auto results = client.process(lookups.empty() ? 100ms : 10ms, token);
+
+            // Hedge: for each late address, query a spare one; whichever replies is used.
+            for (auto late : client.take_late()) {
+                if (hedges_left <= 0 || spares.empty())
+                    break;
+                // Already hedged, or a hedge itself.
+                if (partners.contains(late))
+                    continue;
+                auto spare = spares.front();
+                spares.pop_front();
+                if (good_spares)
+                    --good_spares;
+                --hedges_left;
+                --skipped;
+                client.add(spare, scorecard::retransmit_timeout(spare));
+                partners[late] = spare;
+                partners[spare] = late;
+                if (!silent)
+                    notify::info(notify::level::verbose,
+                                 to_string(late) + " is late, also querying "
+                                 + to_string(spare));
+            }
+
+            for (auto& [address, value, kiss_code] : results) {
+                if (!kiss_code.empty())
+                    scorecard::record_kod(address, kiss_code);
+                if (superseded.erase(address))
+                    continue;
+                if (auto p = partners.find(address); p != partners.end()) {
+                    auto other = p->second;
+                    partners.erase(p);
+                    partners.erase(other);
+                    // If this one failed, the other one can still reply.
+                    if (value && !client.drop(other))
+                        superseded.insert(other);
                 }
-                catch (std::exception& e) {
+                if (value) {
+                    scorecard::record_reply(address, 2 * value->latency, value->stratum);
+                    replied.push_back(address);
+                    candidates.push_back({ value->correction, ntp::root_distance(*value) });
+                    poll_exps.push_back(value->poll_exp);
                     if (!silent)
-                        notify::error(notify::level::verbose, e.what());
+                        notify::info(notify::level::verbose,
+                                     to_string(address)
+                                     + ": correction = "s
+                                     + seconds_to_human(value->correction, true)
+                                     + ", latency = "s + seconds_to_human(value->latency)
+                                     + ", jitter = "s + seconds_to_human(value->jitter));
+                } else {
+                    if (kiss_code.empty())
+                        scorecard::record_loss(address);
+                    if (!silent)
+                        notify::error(notify::level::verbose,
+                                      to_string(address) + ": "s + value.error());
+                }
+            }
+
+            // Stop early if enough servers already agree.
+            if (cfg::quorum > 0 && candidates.size() >= static_cast<unsigned>(cfg::quorum)) {
+                auto sel = ntp::select(candidates);
+                if (sel
+                    && sel->survivors.size() >= static_cast<unsigned>(cfg::quorum)
+                    && ntp::spread(candidates, *sel) <= cfg::quorum_bound) {
+                    if (!silent
+                        && (!client.empty() || !lookups.empty() || next_server < servers.size()))
+                        notify::info(notify::level::verbose,
+                                     "Quorum reached with "
+                                     + std::to_string(sel->survivors.size())
+                                     + " servers, other queries canceled.");
+                    // Note: lookups still running will only update the DNS cache.
+                    client.cancel();
+                    next_server = servers.size();
+                    break;
                 }
+            }
         }
 
-        if (addresses.empty()) {
+        scorecard::save();
+
+        // Only useful when diagnosing slot contention, keep it out of the regular log.
+        if (static_cast<int>(notify::level::verbose) <= cfg::notify) {
+            auto slots = net::io_slots::get_counters();
+            logger::printf("I/O slots: %llu acquired, %llu waited (%llu timed out),"
+                           " max wait %s, max in use %u\n",
+                           static_cast<unsigned long long>(slots.acquired),
+                           static_cast<unsigned long long>(slots.contended),
+                           static_cast<unsigned long long>(slots.timed_out),
+                           seconds_to_human(slots.max_wait).c_str(),
+                           slots.max_in_use);
+        }
+
+        if (seen.empty()) {
             // Probably a mistake in config, or network failure.
-            throw runtime_error{"No NTP address could be used."};
+            throw network_error{"No NTP address could be used."};
         }
 
-        // cancellation point: before the NTP queries are submitted
-        check_stop(token);
+        if (!silent && skipped)
+            notify::info(notify::level::verbose,
+                         "Skipped " + std::to_string(skipped)
+                         + " of " + std::to_string(seen.size())
+                         + " addresses, based on previous results.");
 
-        // Launch NTP queries asynchronously.
-        std::vector<std::future<std::pair<dbl_seconds, dbl_seconds>>>
-            futures(addresses.size());
-        for (auto [fut, address] : std::views::zip(futures, addresses))
-            fut = pool.submit(ntp_query, token, address);
 
-        // cancellation point: after NTP queries are submited
-        check_stop(token);
+        if (candidates.empty())
+            throw network_error{"No NTP server could be used!"};
 
-        // Collect all future results.
-        std::vector<dbl_seconds> corrections;
-        for (auto [address, fut] : std::views::zip(addresses, futures))
-            try {
-                // cancellation point: before blocking waiting for a NTP result
-                check_stop(token);
-                auto [correction, latency] = fut.get();
-                corrections.push_back(correction);
-                if (!silent)
-                    notify::info(notify::level::verbose,
-                                 to_string(address)
-                                 + ": correction = "s + seconds_to_human(correction, true)
-                                 + ", latency = "s + seconds_to_human(latency));
-            }
-            catch (canceled_error&) {
-                throw;
-            }
-            catch (std::exception& e) {
-                if (!silent)
-                    notify::error(notify::level::verbose,
-                                  to_string(address) + ": "s + e.what());
-            }
+        // Discard the servers that disagree with the majority.
+        auto sel = ntp::select(candidates);
+        if (!sel)
+            throw runtime_error{"NTP servers disagree, no majority was found!"};
 
+        if (!silent)
+            for (std::size_t i = 0, j = 0; i < candidates.size(); ++i) {
+                if (j < sel->survivors.size() && sel->survivors[j] == i) {
+                    ++j;
+                    continue;
+                }
+                notify::error(notify::level::verbose,
+                              to_string(replied[i]) + ": discarded, disagrees with the majority.");
+            }
 
-        if (corrections.empty())
-            throw runtime_error{"No NTP server could be used!"};
+        auto [correction, error] = ntp::combine(candidates, *sel);
 
+        // Don't poll faster than any of the servers we rely on asks for.
+        int poll_exp = 0;
+        for (auto i : sel->survivors)
+            poll_exp = std::max(poll_exp, poll_exps[i]);
 
-        dbl_seconds total = std::accumulate(corrections.begin(),
-                                            corrections.end(),
-                                            dbl_seconds{0});
-        dbl_seconds avg = total / static_cast<double>(corrections.size());
+        if (!silent)
+            notify::info(notify::level::verbose,
+                         "Combined correction: " + seconds_to_human(correction, true)
+                         + " ± " + seconds_to_human(error));
 
-        if (abs(avg) <= cfg::tolerance) {
+        if (abs(correction) <= cfg::tolerance) {
             if (!silent)
                 notify::success(notify::level::verbose,
                                 "Tolerating clock drift (correction is only "
-                                + seconds_to_human(avg, true) + ")."s);
-            return;
+                                + seconds_to_human(correction, true) + ")."s);
+            return { correction, error, poll_exp };
+        }
+
+        // If the error is that large, stepping might not make the clock any better.
+        if (abs(correction) <= error) {
+            if (!silent)
+                notify::info(notify::level::normal,
+                             "Not correcting the clock, the correction ("
+                             + seconds_to_human(correction, true)
+                             + ") is smaller than its error bound ("
+                             + seconds_to_human(error) + ").");
+            return { correction, error, poll_exp };
         }
 
         // cancellation point: before modifying the clock
         check_stop(token);
 
-        if (!apply_clock_correction(avg))
-            throw runtime_error{"Failed to set system clock!"};
+        bool slewing = correct_clock(correction);
+
+        drift::record(correction);
+
+        if (!silent)
+            notify::success(notify::level::normal, correction_message(correction, slewing));
+
+        return { correction, error, poll_exp };
+    }
+
+
+    // Use the drift model to correct the clock, when NTP can't be used.
+    void
+    run_holdover(bool silent)
+    {
+        using time_utils::seconds_to_human;
+
+        auto pred = drift::predict();
+        if (!pred || abs(pred->correction) <= cfg::tolerance)
+            return;
+
+        bool slewing = correct_clock(pred->correction);
+
+        drift::record_holdover(pred->correction);
 
         if (!silent)
             notify::success(notify::level::normal,
-                            "Clock corrected by " + seconds_to_human(avg, true));
+                            correction_message(pred->correction, slewing)
+                            + " (predicted from drift history)");
+    }
+
 
+    // Check if the drift model is confident that a sync is unnecessary.
+    bool
+    can_skip_sync(bool silent)
+    {
+        using time_utils::seconds_to_human;
+
+        auto pred = drift::predict();
+        if (!pred)
+            return false;
+
+        // "Comfortably" inside the tolerance means using only half of it.
+        if (abs(pred->correction) + pred->error >= cfg::tolerance / 2)
+            return false;
+
+        if (!silent)
+            notify::success(notify::level::verbose,
+                            "Skipping sync, predicted drift is only "
+                            + seconds_to_human(pred->correction, true)
+                            + " ± " + seconds_to_human(pred->error) + ".");
+        return true;
     }
 
 
@@ -454,7 +545,23 @@ namespace core {
 
     namespace background {
 
+        using clock = std::chrono::steady_clock;
+
+        // pool.ntp.org asks simple clients to not query more often than this.
+        constexpr std::chrono::seconds min_interval = 30min;
+
+        // RFC 5905's MAXPOLL, 2^17 seconds.
+        constexpr std::chrono::seconds max_interval{1 << 17};
+
+        // Where the interval starts, before anything is known about the drift.
+        constexpr std::chrono::seconds initial_interval = 1h;
+
+        // Protects stopper and timer, and signals state changes.
+        std::mutex mutex;
+        std::condition_variable state_changed;
         std::stop_source stopper{std::nostopstate};
+        // The next run of the task, while it's waiting.
+        timer_handle timer;
 
         enum class state_t : unsigned {
             none,
@@ -465,43 +572,170 @@ namespace core {
         std::atomic<state_t> state{state_t::none};
 
 
+        // Called by the task when it's done running.
         void
-        run()
+        set_state(state_t new_state)
         {
-            state = state_t::started;
+            std::lock_guard lock{mutex};
+            state = new_state;
+            state_changed.notify_all();
+        }
+
+        // The schedule survives across applications, so switching applications doesn't
+        // trigger a new sync. Only accessed by the background task, or while it's stopped.
+        clock::time_point next_sync;
+        std::chrono::seconds interval = initial_interval;
 
-            std::jthread t{
-                [](std::stop_token token)
-                {
-                    wups::logger::guard logger_guard{PACKAGE_NAME};
-                    notify::guard notify_guard;
+
+        /*
+         * Adapt the interval to how well the clock keeps time: it's halved when the
+         * correction uses up more than half the tolerance, doubled when it's below a quarter.
+         * It's also limited by how long the estimated drift takes to reach half the
+         * tolerance, and never faster than the servers' poll interval.
+         */
+        std::chrono::seconds
+        next_interval(const report& rep)
+        {
+            using std::chrono::seconds;
+
+            seconds next = interval;
+            if (abs(rep.correction) > cfg::tolerance / 2)
+                next /= 2;
+            else if (abs(rep.correction) < cfg::tolerance / 4)
+                next *= 2;
+
+            if (auto ppm = drift::frequency_ppm(); ppm && *ppm != 0) {
+                dbl_seconds limit = dbl_seconds{cfg::tolerance} / 2 / (std::abs(*ppm) * 1e-6);
+                if (limit < next)
+                    next = std::chrono::duration_cast<seconds>(limit);
+            }
+
+            seconds server_min{1 << std::clamp(rep.poll_exp, 0, 17)};
+            next = std::max(next, server_min);
+
+            return std::clamp(next, min_interval, max_interval);
+        }
+
+
+        void task(std::stop_token token, bool may_skip);
+
+
+        // Run the task at the given time; assumes the mutex is locked.
+        void
+        schedule(clock::time_point when,
+                 std::stop_token token,
+                 bool may_skip)
+        {
+            // Note: no thread is used until it's time to run.
+            timer = executor::submit_at(when, [token, may_skip] { task(token, may_skip); });
+        }
+
+
+        // The network is not usable, use the drift model instead, and try again sooner.
+        void
+        holdover()
+        {
+            try {
+                run_holdover(false);
+            }
+            catch (std::exception& e) {
+                notify::error(notify::level::normal, e.what());
+            }
+            interval = min_interval;
+        }
+
+
+        /*
+         * Sync once, then schedule the next sync if periodic sync is enabled.
+         *
+         * The drift model may only skip boot and periodic syncs; a sync requested by a
+         * configuration change (like the time zone) must always happen.
+         */
+        void
+        task(std::stop_token token,
+             bool may_skip)
+        {
+            wups::logger::guard logger_guard{PACKAGE_NAME};
+            notify::guard notify_guard;
+            try {
+                check_stop(token);
+                if (!may_skip || !can_skip_sync(false)) {
                     try {
-                        // Note: we wait 5 seconds, to minimize spurious network errors.
-                        sleep_for(5s, token);
-                        core::run(token, false);
-                        state = state_t::finished;
+                        interval = next_interval(core::run(token, false));
+                    }
+                    catch (canceled_error&) {
+                        throw;
+                    }
+                    catch (network_error& e) {
+                        notify::error(notify::level::normal, e.what());
+                        holdover();
                     }
-                    catch (canceled_error& e) {
-                        state = state_t::canceled;
+                    catch (net::error& e) {
+                        notify::error(notify::level::normal, e.what());
+                        holdover();
                     }
                     catch (std::exception& e) {
+                        // The servers were reachable, a measurement is better than a guess.
                         notify::error(notify::level::normal, e.what());
-                        state = state_t::finished;
+                        interval = min_interval;
                     }
                 }
-            };
+                next_sync = clock::now() + interval;
+                if (cfg::sync_periodic) {
+                    logger::printf("Next sync in %s\n",
+                                   time_utils::seconds_to_human(interval).c_str());
+                    std::lock_guard lock{mutex};
+                    // Once stop() cancels the timer, no new one can be scheduled.
+                    check_stop(token);
+                    schedule(next_sync, token, true);
+                    return;
+                }
+                set_state(state_t::finished);
+            }
+            catch (canceled_error& e) {
+                set_state(state_t::canceled);
+            }
+            catch (std::exception& e) {
+                // Nothing else will run, stop() must not wait for it.
+                notify::error(notify::level::normal, e.what());
+                set_state(state_t::finished);
+            }
+        }
 
-            stopper = t.get_stop_source();
 
-            t.detach();
+        void
+        launch(bool may_skip)
+        {
+            state = state_t::started;
+
+            std::lock_guard lock{mutex};
+            stopper = std::stop_source{};
+            // Note: we wait at least 5 seconds, to minimize spurious network errors.
+            schedule(std::max(next_sync, clock::now() + 5s), stopper.get_token(), may_skip);
+        }
+
+
+        void
+        run()
+        {
+            // Sync right away.
+            next_sync = {};
+            launch(false);
         }
 
 
         void
         run_once()
         {
-            if (state != state_t::finished)
-                run();
+            if (state == state_t::started)
+                return;
+            if (cfg::sync_periodic)
+                launch(true); // resume the schedule
+            else if (state != state_t::finished) {
+                // Boot sync.
+                next_sync = {};
+                launch(true);
+            }
         }
 
 
@@ -509,19 +743,22 @@ namespace core {
         stop()
         {
             if (state == state_t::started) {
+                std::unique_lock lock{mutex};
+                // Note: this also interrupts the task's waits on the network.
                 stopper.request_stop();
+                // If the task is waiting for its timer, it won't run anymore.
+                if (timer.cancel())
+                    state = state_t::canceled;
 
-                // Wait up to ~10 seconds for the thread to flag it stopped running.
-                unsigned max_tries = 100;
-                do {
-                    std::this_thread::sleep_for(100ms);
-                } while ((state == state_t::started) && --max_tries);
-
-                if (state == state_t::started)
+                // Wait up to 10 seconds for the task to flag it stopped running.
+                if (!state_changed.wait_for(lock, 10s,
+                                            [] { return state != state_t::started; }))
                     logger::printf("WARNING: Background thread did not stop!\n");
 
                 stopper = std::stop_source{std::nostopstate};
             }
+
+            cancel_slew();
         }
 
     } // namespace background
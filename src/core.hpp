@@ -11,20 +11,40 @@
 
 #include <stop_token>
 #include <string>
-#include <utility>              // pair<>
+#include <vector>
 
 #include "net/address.hpp"
+#include "ntp_client.hpp"
+#include "task_future.hpp"
 #include "time_utils.hpp"
 
 
 namespace core {
 
-    using time_utils::dbl_seconds;
+    // Step the clock; returns false if it failed.
+    bool
+    apply_clock_correction(ntp::fixed_seconds correction);
 
-    std::pair<dbl_seconds, dbl_seconds> ntp_query(std::stop_token token,
-                                                  net::address address);
 
-    void
+    // Resolve a NTP server name, using the DNS cache and the shared executor.
+    task_future<std::vector<net::address>>
+    resolve(const std::string& name);
+
+
+    // NTP client options, taken from the current configuration.
+    ntp::client::options
+    get_ntp_options();
+
+
+    // What a successful run() learned from the NTP servers.
+    struct report {
+        time_utils::dbl_seconds correction; // measured, even if it was not applied
+        time_utils::dbl_seconds error;      // the true correction is within ± error
+        int poll_exp;                       // largest poll exponent of the servers used
+    };
+
+
+    report
     run(std::stop_token token,
         bool silent);
 
@@ -0,0 +1,331 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef CORO_HPP
+#define CORO_HPP
+
+#include <coroutine>
+#include <exception>            // current_exception(), exception_ptr, rethrow_exception()
+#include <optional>
+#include <type_traits>          // is_void_v<>
+#include <utility>              // exchange(), forward(), move()
+
+#include "task_future.hpp"
+
+
+/*
+ * Minimal coroutine support.
+ *
+ * A coro::task<T> is a lazy coroutine: it only starts when awaited, and when it finishes,
+ * it resumes whoever awaited it. Use coro::spawn() to start one from regular code; the
+ * result comes out of a task_future<T>.
+ *
+ * Waiting on sockets and timers is done by the reactor (see reactor.hpp), so a suspended
+ * coroutine only costs its frame, not a thread.
+ */
+
+namespace coro {
+
+    template<typename T = void>
+    class task;
+
+
+    namespace detail {
+
+        struct promise_base {
+
+            std::coroutine_handle<> continuation = std::noop_coroutine();
+            std::exception_ptr error;
+
+
+            std::suspend_always
+            initial_suspend()
+                noexcept
+            {
+                return {};
+            }
+
+
+            struct final_awaiter {
+
+                bool
+                await_ready()
+                    noexcept
+                {
+                    return false;
+                }
+
+
+                template<typename P>
+                std::coroutine_handle<>
+                await_suspend(std::coroutine_handle<P> h)
+                    noexcept
+                {
+                    return h.promise().continuation;
+                }
+
+
+                void
+                await_resume()
+                    noexcept
+                {}
+
+            };
+
+
+            final_awaiter
+            final_suspend()
+                noexcept
+            {
+                return {};
+            }
+
+
+            void
+            unhandled_exception()
+                noexcept
+            {
+                error = std::current_exception();
+            }
+
+        };
+
+
+        template<typename T>
+        struct promise : promise_base {
+
+            std::optional<T> value;
+
+
+            task<T>
+            get_return_object()
+                noexcept;
+
+
+            template<typename U>
+            void
+            return_value(U&& x)
+            {
+                value.emplace(std::forward<U>(x));
+            }
+
+
+            T
+            result()
+            {
+                if (error)
+                    std::rethrow_exception(error);
+                return std::move(*value);
+            }
+
+        };
+
+
+        template<>
+        struct promise<void> : promise_base {
+
+            task<void>
+            get_return_object()
+                noexcept;
+
+
+            void
+            return_void()
+                noexcept
+            {}
+
+
+            void
+            result()
+            {
+                if (error)
+                    std::rethrow_exception(error);
+            }
+
+        };
+
+
+        // A coroutine that nobody awaits; its frame is destroyed when it finishes.
+        struct detached {
+
+            struct promise_type {
+
+                detached
+                get_return_object()
+                    noexcept
+                {
+                    return {};
+                }
+
+
+                std::suspend_never
+                initial_suspend()
+                    noexcept
+                {
+                    return {};
+                }
+
+
+                std::suspend_never
+                final_suspend()
+                    noexcept
+                {
+                    return {};
+                }
+
+
+                void
+                return_void()
+                    noexcept
+                {}
+
+
+                void
+                unhandled_exception()
+                    noexcept
+                {
+                    std::terminate();
+                }
+
+            };
+
+        };
+
+    } // namespace detail
+
+
+    template<typename T>
+    class task {
+
+    public:
+
+        using promise_type = detail::promise<T>;
+
+    private:
+
+        std::coroutine_handle<promise_type> handle;
+
+    public:
+
+        explicit
+        task(std::coroutine_handle<promise_type> handle)
+            noexcept :
+            handle{handle}
+        {}
+
+
+        task(task&& other)
+            noexcept :
+            handle{std::exchange(other.handle, nullptr)}
+        {}
+
+
+        task&
+        operator =(task&& other)
+            noexcept
+        {
+            if (this != &other) {
+                if (handle)
+                    handle.destroy();
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+
+
+        ~task()
+        {
+            if (handle)
+                handle.destroy();
+        }
+
+
+        bool
+        await_ready()
+            const noexcept
+        {
+            return false;
+        }
+
+
+        // Start the coroutine; it resumes the awaiting one when it finishes.
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<> awaiting)
+            noexcept
+        {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+
+
+        T
+        await_resume()
+        {
+            return handle.promise().result();
+        }
+
+    };
+
+
+    namespace detail {
+
+        template<typename T>
+        task<T>
+        promise<T>::get_return_object()
+            noexcept
+        {
+            return task<T>{std::coroutine_handle<promise<T>>::from_promise(*this)};
+        }
+
+
+        inline
+        task<void>
+        promise<void>::get_return_object()
+            noexcept
+        {
+            return task<void>{std::coroutine_handle<promise<void>>::from_promise(*this)};
+        }
+
+
+        template<typename T>
+        detached
+        run_detached(task<T> t,
+                     task_promise<T> result)
+        {
+            try {
+                if constexpr (std::is_void_v<T>) {
+                    co_await t;
+                    result.set_value();
+                } else
+                    result.set_value(co_await t);
+            }
+            catch (...) {
+                result.set_exception(std::current_exception());
+            }
+        }
+
+    } // namespace detail
+
+
+    /*
+     * Start a task; it runs in this thread until it first suspends, then in whichever
+     * thread resumes it.
+     */
+    template<typename T>
+    task_future<T>
+    spawn(task<T> t)
+    {
+        task_promise<T> result;
+        auto future = result.get_future();
+        detail::run_detached(std::move(t), std::move(result));
+        return future;
+    }
+
+} // namespace coro
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>            // ranges::min_element()
+#include <chrono>
+#include <cstdint>
+#include <exception>            // make_exception_ptr()
+#include <map>
+#include <mutex>
+#include <stdexcept>            // runtime_error
+#include <string>
+
+#include <wupsxx/logger.hpp>
+#include <wupsxx/storage.hpp>
+
+#include "dns_cache.hpp"
+
+#include "net/addrinfo.hpp"
+#include "time_utils.hpp"
+#include "utc.hpp"
+#include "utils.hpp"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+
+using namespace std::literals;
+
+namespace logger = wups::logger;
+
+using time_utils::dbl_seconds;
+
+
+namespace dns_cache {
+
+    namespace {
+
+        const char* storage_key = "dns_cache";
+
+        // Addresses younger than this are used without a new lookup.
+        constexpr dbl_seconds fresh_time = 1h;
+
+        // Addresses older than this are not used at all.
+        constexpr dbl_seconds max_age = 7 * 24h;
+
+        // How long to remember that a name doesn't exist.
+        constexpr dbl_seconds negative_time = 10min;
+
+        // Keep the stored string small.
+        constexpr std::size_t max_entries = 16;
+
+
+        struct entry {
+            std::int64_t updated = 0;          // UTC ticks
+            std::vector<net::address> addresses; // empty if the name doesn't exist
+            std::string error;                 // why the name doesn't exist
+        };
+
+
+        std::mutex mutex;
+
+        bool loaded = false;
+        std::map<std::string, entry> entries; // key is "name:service"
+
+
+        // Note: the functions below assume the mutex is locked.
+
+
+        void
+        load()
+        {
+            if (loaded)
+                return;
+            loaded = true;
+
+            try {
+                auto str = wups::storage::load<std::string>(storage_key);
+                if (!str)
+                    return;
+                // Format, one line per entry: key updated ip:port,... [error]
+                for (auto& line : utils::split(*str, "\n")) {
+                    auto fields = utils::split(line, " ", 4);
+                    if (fields.size() < 3)
+                        continue;
+                    entry e;
+                    e.updated = std::stoll(fields[1]);
+                    if (fields[2] != "-")
+                        for (auto& token : utils::split(fields[2], ",")) {
+                            auto parts = utils::split(token, ":");
+                            if (parts.size() != 2)
+                                continue;
+                            e.addresses.emplace_back(static_cast<net::ipv4_t>(std::stoul(parts[0])),
+                                                     static_cast<net::port_t>(std::stoul(parts[1])));
+                        }
+                    if (fields.size() > 3)
+                        e.error = fields[3];
+                    entries[fields[0]] = std::move(e);
+                }
+            }
+            catch (std::exception& e) {
+                logger::printf("Error loading DNS cache: %s\n", e.what());
+                entries.clear();
+            }
+        }
+
+
+        void
+        save()
+        {
+            const std::int64_t now = utc::now().ticks;
+            std::erase_if(entries,
+                          [now](const auto& kv)
+                          {
+                              return utc::from_ticks(now - kv.second.updated) > max_age;
+                          });
+            while (entries.size() > max_entries) {
+                auto oldest = std::ranges::min_element(entries, {},
+                                                       [](const auto& kv)
+                                                       {
+                                                           return kv.second.updated;
+                                                       });
+                entries.erase(oldest);
+            }
+
+            std::string str;
+            for (auto& [key, e] : entries) {
+                str += key + " " + std::to_string(e.updated) + " ";
+                if (e.addresses.empty())
+                    str += "-";
+                for (std::size_t i = 0; i < e.addresses.size(); ++i) {
+                    if (i)
+                        str += ",";
+                    str += std::to_string(e.addresses[i].ip) + ":"
+                        + std::to_string(e.addresses[i].port);
+                }
+                if (!e.error.empty())
+                    str += " " + e.error;
+                str += "\n";
+            }
+
+            logger::guard guard(PACKAGE_NAME);
+            try {
+                wups::storage::store(storage_key, str);
+                wups::storage::save();
+            }
+            catch (std::exception& e) {
+                logger::printf("Error storing DNS cache: %s\n", e.what());
+            }
+        }
+
+
+        dbl_seconds
+        age(const entry& e)
+        {
+            return utc::from_ticks(utc::now().ticks - e.updated);
+        }
+
+
+        // Do the actual lookup, and update the cache.
+        std::vector<net::address>
+        refresh(const std::string& name,
+                const std::string& service)
+        {
+            const std::string key = name + ":" + service;
+
+            net::addrinfo::hints opts{ .type = net::socket::type::udp };
+            std::vector<net::address> addresses;
+            try {
+                for (auto& info : net::addrinfo::lookup(name, service, opts))
+                    addresses.push_back(info.addr);
+            }
+            catch (net::addrinfo::error& e) {
+                // Only remember names that don't exist; other errors are likely temporary.
+                if (e.code == EAI_NONAME) {
+                    std::lock_guard guard{mutex};
+                    load();
+                    entries[key] = { utc::now().ticks, {}, e.what() };
+                    save();
+                }
+                throw;
+            }
+
+            if (!addresses.empty()) {
+                std::lock_guard guard{mutex};
+                load();
+                entries[key] = { utc::now().ticks, addresses, {} };
+                save();
+            }
+
+            return addresses;
+        }
+
+    } // namespace
+
+
+    task_future<std::vector<net::address>>
+    resolve(const std::string& name,
+            const std::string& service,
+            thread_pool& pool,
+            thread_pool& background)
+    {
+        task_promise<std::vector<net::address>> cached;
+        bool hit = false;
+        bool stale = false;
+        {
+            std::lock_guard guard{mutex};
+            load();
+
+            auto it = entries.find(name + ":" + service);
+            if (it != entries.end()) {
+                const entry& e = it->second;
+                // Note: the clock might be wrong, entries from the future are not fresh.
+                dbl_seconds a = age(e);
+                if (e.addresses.empty()) {
+                    if (a >= 0s && a < negative_time) {
+                        cached.set_exception(std::make_exception_ptr(std::runtime_error{e.error}));
+                        hit = true;
+                    }
+                } else if (a < max_age) {
+                    cached.set_value(e.addresses);
+                    hit = true;
+                    stale = a < 0s || a >= fresh_time;
+                }
+            }
+        }
+
+        // Note: submit() without the lock; refresh() needs it, and it may run right here.
+        if (!hit)
+            return pool.submit(refresh, name, service);
+        if (stale)
+            // Nobody waits for this result, it only updates the cache.
+            background.submit(refresh, name, service);
+        return cached.get_future();
+    }
+
+} // namespace dns_cache
@@ -0,0 +1,43 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DNS_CACHE_HPP
+#define DNS_CACHE_HPP
+
+#include <string>
+#include <vector>
+
+#include "net/address.hpp"
+#include "task_future.hpp"
+#include "thread_pool.hpp"
+
+
+/*
+ * Cache of UDP name lookups, kept in storage.
+ *
+ * The resolver is often slow right after boot, so cached addresses are used immediately,
+ * even if they're old; in that case, a new lookup is done in the background to refresh the
+ * cache. Names that don't exist are also cached for a while, so a misconfigured server
+ * doesn't cost a resolver timeout every time.
+ */
+
+namespace dns_cache {
+
+    /*
+     * Resolve a name, using the pool to run lookups. Stale entries are refreshed on the
+     * background pool, since nobody waits for that.
+     */
+    task_future<std::vector<net::address>>
+    resolve(const std::string& name,
+            const std::string& service,
+            thread_pool& pool,
+            thread_pool& background);
+
+} // namespace dns_cache
+
+#endif
@@ -0,0 +1,269 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <chrono>
+#include <cmath>                // sqrt()
+#include <cstdint>
+#include <cstdio>               // snprintf()
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include <wupsxx/logger.hpp>
+#include <wupsxx/storage.hpp>
+
+#include "drift.hpp"
+
+#include "cfg.hpp"
+#include "utc.hpp"
+#include "utils.hpp"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+
+using namespace std::literals;
+
+namespace logger = wups::logger;
+
+
+namespace drift {
+
+    namespace {
+
+        const char* storage_key = "drift";
+
+        // How many measurements to remember.
+        constexpr std::size_t max_history = 8;
+
+        // How many measurements are needed before predicting anything.
+        constexpr std::size_t min_history = 2;
+
+        // Measurements closer than this are dominated by NTP noise, not drift.
+        constexpr dbl_seconds min_interval = 10min;
+
+        // Don't trust predictions too far from the last measurement.
+        constexpr dbl_seconds max_age = 7 * 24h;
+
+        // Error that remains even if the frequency is known perfectly.
+        constexpr dbl_seconds min_error = 20ms;
+
+
+        struct measurement {
+            dbl_seconds interval; // time since the previous measurement
+            dbl_seconds accrued;  // how much the clock drifted in that interval
+        };
+
+
+        struct model {
+            double freq;       // seconds gained per second
+            double freq_error; // standard deviation of freq
+        };
+
+
+        std::mutex mutex;
+
+        bool loaded = false;
+        bool has_reference = false;
+        std::int64_t ref_utc = 0;        // UTC ticks of the last correction
+        std::int64_t ref_mono = 0;       // monotonic ticks of the last correction
+        bool ref_this_boot = false;      // ref_mono is only meaningful in the same boot
+        dbl_seconds holdover{0};         // predicted corrections applied since then
+        std::chrono::minutes ref_offset{0}; // cfg::utc_offset when the reference was taken
+        std::deque<measurement> history;
+
+
+        // Note: all functions below assume the mutex is locked.
+
+
+        void
+        load()
+        {
+            if (loaded)
+                return;
+            loaded = true;
+
+            try {
+                auto str = wups::storage::load<std::string>(storage_key);
+                if (!str)
+                    return;
+                // Format: ref_utc holdover ref_offset [interval accrued]...
+                auto tokens = utils::split(*str, " ");
+                if (tokens.size() < 3 || tokens.size() % 2 == 0)
+                    return;
+                ref_utc = std::stoll(tokens[0]);
+                holdover = dbl_seconds{std::stod(tokens[1])};
+                ref_offset = std::chrono::minutes{std::stoi(tokens[2])};
+                for (std::size_t i = 3; i + 1 < tokens.size(); i += 2)
+                    history.push_back({ dbl_seconds{std::stod(tokens[i])},
+                                        dbl_seconds{std::stod(tokens[i + 1])} });
+                has_reference = true;
+            }
+            catch (std::exception& e) {
+                logger::printf("Error loading drift history: %s\n", e.what());
+                has_reference = false;
+                history.clear();
+            }
+        }
+
+
+        void
+        save()
+        {
+            std::string str = std::to_string(ref_utc);
+            auto append = [&str](dbl_seconds s)
+            {
+                char buf[32];
+                std::snprintf(buf, sizeof buf, " %.9g", s.count());
+                str += buf;
+            };
+            append(holdover);
+            str += " " + std::to_string(ref_offset.count());
+            for (auto& m : history) {
+                append(m.interval);
+                append(m.accrued);
+            }
+
+            logger::guard guard(PACKAGE_NAME);
+            try {
+                wups::storage::store(storage_key, str);
+                wups::storage::save();
+            }
+            catch (std::exception& e) {
+                logger::printf("Error storing drift history: %s\n", e.what());
+            }
+        }
+
+
+        std::optional<model>
+        estimate()
+        {
+            if (history.size() < min_history)
+                return {};
+
+            // Total drift over total time, so longer intervals have more weight.
+            dbl_seconds total_interval{0};
+            dbl_seconds total_accrued{0};
+            for (auto& m : history) {
+                total_interval += m.interval;
+                total_accrued += m.accrued;
+            }
+            double freq = total_accrued / total_interval;
+
+            // Weighted standard deviation of the frequency of each interval.
+            double sum_sq = 0;
+            for (auto& m : history) {
+                double diff = m.accrued / m.interval - freq;
+                sum_sq += diff * diff * (m.interval / total_interval);
+            }
+
+            return model{ freq, std::sqrt(sum_sq) };
+        }
+
+
+        /*
+         * Within the same boot, the monotonic clock measures the interval exactly. It
+         * restarts with the console, so across boots only the UTC clock can be used; it
+         * kept running, and was correct after the last correction.
+         */
+        dbl_seconds
+        time_since_reference()
+        {
+            if (ref_this_boot)
+                return utc::from_ticks(utc::monotonic_ticks() - ref_mono);
+            return utc::from_ticks(utc::now().ticks - ref_utc);
+        }
+
+    } // namespace
+
+
+    void
+    record(dbl_seconds correction)
+    {
+        std::lock_guard guard{mutex};
+        load();
+
+        // The UTC clock depends on the time zone offset; a correction after a change of
+        // offset measures the change, not the drift. The older history is still valid.
+        if (has_reference && ref_offset != cfg::utc_offset)
+            has_reference = false;
+
+        if (has_reference) {
+            dbl_seconds interval = time_since_reference();
+            // Note: too soon, the correction is mostly NTP noise; only move the reference.
+            if (interval >= min_interval) {
+                history.push_back({ interval, correction + holdover });
+                if (history.size() > max_history)
+                    history.pop_front();
+            }
+        }
+
+        has_reference = true;
+        ref_utc = utc::now().ticks;
+        ref_mono = utc::monotonic_ticks();
+        ref_this_boot = true;
+        holdover = 0s;
+        ref_offset = cfg::utc_offset;
+
+        save();
+    }
+
+
+    void
+    record_holdover(dbl_seconds correction)
+    {
+        std::lock_guard guard{mutex};
+        load();
+
+        if (!has_reference || ref_offset != cfg::utc_offset)
+            return;
+
+        holdover += correction;
+
+        save();
+    }
+
+
+    std::optional<prediction>
+    predict()
+    {
+        std::lock_guard guard{mutex};
+        load();
+
+        if (!has_reference || ref_offset != cfg::utc_offset)
+            return {};
+
+        auto m = estimate();
+        if (!m)
+            return {};
+
+        dbl_seconds elapsed = time_since_reference();
+        if (elapsed < 0s || elapsed > max_age)
+            return {};
+
+        return prediction{
+            m->freq * elapsed - holdover,
+            min_error + m->freq_error * elapsed
+        };
+    }
+
+
+    std::optional<double>
+    frequency_ppm()
+    {
+        std::lock_guard guard{mutex};
+        load();
+
+        auto m = estimate();
+        if (!m)
+            return {};
+        return m->freq * 1e6;
+    }
+
+} // namespace drift
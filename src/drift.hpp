@@ -0,0 +1,53 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef DRIFT_HPP
+#define DRIFT_HPP
+
+#include <optional>
+
+#include "time_utils.hpp"
+
+
+/*
+ * Model of the local oscillator's frequency error.
+ *
+ * Every time the clock is corrected from NTP, we learn how much it drifted since the
+ * previous correction. The history is stored, so the frequency error can be estimated
+ * across reboots, and used to predict the current clock error without using the network.
+ */
+
+namespace drift {
+
+    using time_utils::dbl_seconds;
+
+
+    struct prediction {
+        dbl_seconds correction; // how much the clock is expected to need
+        dbl_seconds error;      // how uncertain that is
+    };
+
+
+    // Record a correction measured by NTP and applied to the clock.
+    void record(dbl_seconds correction);
+
+
+    // Record a correction that was applied from a prediction, not from a measurement.
+    void record_holdover(dbl_seconds correction);
+
+
+    // Predict the correction needed now; empty if there isn't enough history.
+    std::optional<prediction> predict();
+
+
+    // The estimated frequency error, in parts per million.
+    std::optional<double> frequency_ppm();
+
+} // namespace drift
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <memory>               // unique_ptr<>
+#include <stdexcept>            // logic_error
+
+#include "executor.hpp"
+
+#include "net/io_slots.hpp"
+
+
+namespace executor {
+
+    namespace {
+
+        // Every DNS lookup holds an I/O slot, more workers would only wait for one. Plus the
+        // background sync task, and a task started from the config menu.
+        constexpr unsigned max_workers = net::io_slots::capacity + 2;
+
+        std::unique_ptr<thread_pool> pool;
+        std::unique_ptr<timer_wheel> wheel;
+
+    } // namespace
+
+
+    void
+    init()
+    {
+        pool = std::make_unique<thread_pool>(max_workers);
+        wheel = std::make_unique<timer_wheel>();
+    }
+
+
+    void
+    finalize()
+    {
+        // Pending timers are discarded; the timer thread must not submit to a dead pool.
+        wheel.reset();
+        pool.reset();
+    }
+
+
+    void
+    release_workers()
+    {
+        if (wheel)
+            wheel->stop();
+        if (pool)
+            pool->release_workers();
+    }
+
+
+    thread_pool&
+    get()
+    {
+        if (!pool)
+            throw std::logic_error{"executor was not initialized"};
+        return *pool;
+    }
+
+
+    timer_wheel&
+    timers()
+    {
+        if (!wheel)
+            throw std::logic_error{"executor was not initialized"};
+        return *wheel;
+    }
+
+} // namespace executor
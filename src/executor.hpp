@@ -0,0 +1,71 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef EXECUTOR_HPP
+#define EXECUTOR_HPP
+
+#include <chrono>
+#include <utility>              // forward(), move()
+
+#include "thread_pool.hpp"
+#include "timer_wheel.hpp"
+
+
+/*
+ * The plugin's shared thread pool.
+ *
+ * All background work (sync tasks, DNS lookups) is submitted here, so worker threads are
+ * reused, and the total number of threads is limited.
+ *
+ * Delayed work is scheduled on a timer wheel, and only submitted to the pool when it's
+ * due, so nothing pins a thread while waiting.
+ */
+
+namespace executor {
+
+    // Called from INITIALIZE_PLUGIN.
+    void init();
+
+    // Called from DEINITIALIZE_PLUGIN; waits for running tasks to finish.
+    void finalize();
+
+    // Join the idle workers and the timer thread, when the application exits; new ones are
+    // created on demand.
+    void release_workers();
+
+    thread_pool& get();
+
+    timer_wheel& timers();
+
+
+    // Submit the task to the pool at the given time.
+    template<typename Func>
+    timer_handle
+    submit_at(timer_wheel::clock::time_point when,
+              Func&& func)
+    {
+        return timers().schedule_at(when,
+                                    [func = std::forward<Func>(func)]() mutable
+                                    {
+                                        get().submit(std::move(func));
+                                    });
+    }
+
+
+    // Submit the task to the pool after the given delay.
+    template<typename Func>
+    timer_handle
+    submit_after(timer_wheel::clock::duration delay,
+                 Func&& func)
+    {
+        return submit_at(timer_wheel::clock::now() + delay, std::forward<Func>(func));
+    }
+
+} // namespace executor
+
+#endif
@@ -13,7 +13,9 @@
 
 #include "cfg.hpp"
 #include "core.hpp"
+#include "executor.hpp"
 #include "notify.hpp"
+#include "reactor.hpp"
 
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -36,18 +38,23 @@ INITIALIZE_PLUGIN()
     wups::logger::guard guard{PACKAGE_NAME};
 
     cfg::init();
+
+    executor::init();
 }
 
 
 DEINITIALIZE_PLUGIN()
 {
     core::background::stop();
+
+    reactor::stop();
+    executor::finalize();
 }
 
 
 ON_APPLICATION_START()
 {
-    if (cfg::sync_on_boot)
+    if (cfg::sync_on_boot || cfg::sync_periodic)
         core::background::run_once();
 }
 
@@ -55,4 +62,8 @@ ON_APPLICATION_START()
 ON_APPLICATION_REQUESTS_EXIT()
 {
     core::background::stop();
+
+    // Don't leave idle threads behind, like the background thread before.
+    reactor::stop();
+    executor::release_workers();
 }
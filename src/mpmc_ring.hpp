@@ -0,0 +1,132 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef MPMC_RING_HPP
+#define MPMC_RING_HPP
+
+#include <atomic>
+#include <cstddef>              // size_t, ptrdiff_t
+#include <new>                  // launder()
+#include <optional>
+#include <type_traits>          // is_nothrow_move_constructible_v<>
+#include <utility>              // move()
+
+
+/*
+ * Bounded multi-producer, multi-consumer lock-free queue.
+ *
+ * This is Dmitry Vyukov's algorithm: each cell has a sequence number that tells producers
+ * and consumers whose turn it is to use it, so they only contend on a single atomic index
+ * each. No memory is allocated after construction.
+ *
+ * Use it through async_queue<T, mpmc_ring<T, N>>, for blocking operations.
+ */
+template<typename T,
+         std::size_t N>
+class mpmc_ring {
+
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "capacity must be a power of 2");
+    static_assert(std::is_nothrow_move_constructible_v<T>,
+                  "a claimed cell can't be given back, so moving must not throw");
+
+    struct cell {
+        std::atomic<std::size_t> seq;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    cell cells[N];
+
+    // Keep the producer and consumer indexes on separate cache lines.
+    alignas(64) std::atomic<std::size_t> head = 0; // next cell to push into
+    alignas(64) std::atomic<std::size_t> tail = 0; // next cell to pop from
+
+public:
+
+    static constexpr std::size_t capacity = N;
+
+
+    mpmc_ring()
+        noexcept
+    {
+        for (std::size_t i = 0; i < N; ++i)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+
+    ~mpmc_ring()
+    {
+        while (try_pop())
+            ;
+    }
+
+
+    mpmc_ring(const mpmc_ring&) = delete;
+
+
+    // Returns false if full; x is only moved from on success.
+    bool
+    try_push(T&& x)
+        noexcept
+    {
+        std::size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            cell& c = cells[pos & (N - 1)];
+            std::size_t seq = c.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    ::new (c.storage) T(std::move(x));
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0)
+                return false; // the consumers haven't freed this cell yet
+            else
+                pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+
+    // Returns an empty optional if empty.
+    std::optional<T>
+    try_pop()
+        noexcept
+    {
+        std::size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            cell& c = cells[pos & (N - 1)];
+            std::size_t seq = c.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    T* ptr = std::launder(reinterpret_cast<T*>(c.storage));
+                    std::optional<T> result{std::move(*ptr)};
+                    ptr->~T();
+                    // Hand the cell over to the producers of the next lap.
+                    c.seq.store(pos + N, std::memory_order_release);
+                    return result;
+                }
+            } else if (diff < 0)
+                return {}; // no producer has filled this cell yet
+            else
+                pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+
+    // Note: only a snapshot, it may be outdated by the time it returns.
+    bool
+    empty()
+        const noexcept
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+};
+
+#endif
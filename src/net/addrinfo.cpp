@@ -12,6 +12,8 @@
 
 #include "addrinfo.hpp"
 
+#include "io_slots.hpp"
+
 
 namespace net::addrinfo {
 
@@ -24,6 +26,12 @@ namespace net::addrinfo {
     using ai_ptr = std::unique_ptr<struct ::addrinfo, addrinfo_deleter>;
 
 
+    error::error(int code) :
+        std::runtime_error{::gai_strerror(code)},
+        code{code}
+    {}
+
+
     int
     to_flags(const hints& opt)
     {
@@ -79,12 +87,14 @@ namespace net::addrinfo {
         }
 
         struct ::addrinfo* raw_result_ptr = nullptr;
+        // Note: the resolver waits on its own socket, so it needs a slot too.
+        io_slots::guard slot;
         int status = ::getaddrinfo(name ? name->c_str() : nullptr,
                                    service ? service->c_str() : nullptr,
                                    raw_hints_ptr,
                                    &raw_result_ptr);
         if (status)
-            throw std::runtime_error{::gai_strerror(status)};
+            throw error{status};
 
         info.reset(raw_result_ptr);
 
@@ -10,6 +10,7 @@
 #define NET_ADDRINFO_HPP
 
 #include <optional>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -30,6 +31,16 @@ namespace net::addrinfo {
     };
 
 
+    // Error from getaddrinfo(), with its EAI_* code.
+    struct error : std::runtime_error {
+
+        int code;
+
+        error(int code);
+
+    };
+
+
     struct result {
         socket::type type;
         address      addr;
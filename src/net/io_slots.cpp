@@ -0,0 +1,161 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>            // max()
+#include <condition_variable>
+#include <mutex>
+
+#include "io_slots.hpp"
+
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+
+namespace net::io_slots {
+
+    namespace {
+
+        using clock = std::chrono::steady_clock;
+
+
+        // Each waiting thread links one of these, from its own stack, into the queue.
+        struct waiter {
+            std::condition_variable cond;
+            bool granted = false;
+            waiter* prev = nullptr;
+            waiter* next = nullptr;
+        };
+
+
+        std::mutex mutex;
+        unsigned available = capacity;
+        waiter* head = nullptr;
+        waiter* tail = nullptr;
+        counters stats;
+
+
+        // Note: all functions below assume the mutex is locked.
+
+
+        void
+        enqueue(waiter& w)
+            noexcept
+        {
+            w.prev = tail;
+            if (tail)
+                tail->next = &w;
+            else
+                head = &w;
+            tail = &w;
+        }
+
+
+        void
+        unlink(waiter& w)
+            noexcept
+        {
+            if (w.prev)
+                w.prev->next = w.next;
+            else
+                head = w.next;
+            if (w.next)
+                w.next->prev = w.prev;
+            else
+                tail = w.prev;
+        }
+
+
+        void
+        granted(clock::duration waited)
+            noexcept
+        {
+            ++stats.acquired;
+            stats.max_in_use = std::max(stats.max_in_use, capacity - available);
+            auto us = duration_cast<microseconds>(waited);
+            stats.total_wait += us;
+            stats.max_wait = std::max(stats.max_wait, us);
+        }
+
+    } // namespace
+
+
+    bool
+    acquire(std::chrono::milliseconds timeout)
+        noexcept
+    {
+        std::unique_lock lock{mutex};
+
+        // Note: don't overtake threads that are already waiting.
+        if (available && !head) {
+            --available;
+            granted(clock::duration::zero());
+            return true;
+        }
+
+        ++stats.contended;
+        if (timeout == timeout.zero()) {
+            ++stats.timed_out;
+            return false;
+        }
+
+        const auto start = clock::now();
+        waiter w;
+        enqueue(w);
+        if (timeout < timeout.zero())
+            w.cond.wait(lock, [&w] { return w.granted; });
+        else if (!w.cond.wait_for(lock, timeout, [&w] { return w.granted; })) {
+            unlink(w);
+            ++stats.timed_out;
+            return false;
+        }
+        // The slot was handed over by release(), already unlinked.
+        granted(clock::now() - start);
+        return true;
+    }
+
+
+    void
+    release()
+        noexcept
+    {
+        std::lock_guard lock{mutex};
+        if (head) {
+            // Hand the slot directly to the oldest waiter.
+            waiter& w = *head;
+            unlink(w);
+            w.granted = true;
+            w.cond.notify_one();
+        } else
+            ++available;
+    }
+
+
+    counters
+    get_counters()
+        noexcept
+    {
+        std::lock_guard lock{mutex};
+        return stats;
+    }
+
+
+    guard::guard(std::chrono::milliseconds timeout)
+        noexcept :
+        owns{acquire(timeout)}
+    {}
+
+
+    guard::~guard()
+        noexcept
+    {
+        if (owns)
+            release();
+    }
+
+} // namespace net::io_slots
@@ -0,0 +1,77 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef NET_IO_SLOTS_HPP
+#define NET_IO_SLOTS_HPP
+
+#include <chrono>
+#include <cstdint>
+
+
+/*
+ * Budget of concurrent socket operations.
+ *
+ * The Wii U OS can only handle 16 concurrent select()/poll() calls, for the whole system,
+ * and fails with ENOMEM beyond that. So socket::try_poll() and socket::try_send() hold a
+ * slot while they run; when none is free, the caller waits for one, in FIFO order.
+ *
+ * If no slot frees up in time, try_poll() fails with EBUSY. That is not a timeout: the
+ * socket was never polled, so data might be waiting in it.
+ */
+
+namespace net::io_slots {
+
+    // How many slots the plugin may use at the same time; the rest is left for the
+    // running application and other plugins.
+    constexpr unsigned capacity = 8;
+
+
+    struct counters {
+        std::uint64_t acquired = 0;     // slots handed out
+        std::uint64_t contended = 0;    // acquisitions that had to wait
+        std::uint64_t timed_out = 0;    // waits that gave up
+        std::chrono::microseconds total_wait{0};
+        std::chrono::microseconds max_wait{0};
+        unsigned max_in_use = 0;
+    };
+
+
+    // Wait up to timeout for a slot; a negative timeout waits forever.
+    bool acquire(std::chrono::milliseconds timeout) noexcept;
+
+    void release() noexcept;
+
+    counters get_counters() noexcept;
+
+
+    class guard {
+
+        bool owns;
+
+    public:
+
+        guard(std::chrono::milliseconds timeout = std::chrono::milliseconds{-1})
+            noexcept;
+
+        ~guard() noexcept;
+
+        guard(const guard&) = delete;
+
+
+        explicit
+        operator bool()
+            const noexcept
+        {
+            return owns;
+        }
+
+    };
+
+} // namespace net::io_slots
+
+#endif
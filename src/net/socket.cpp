@@ -6,6 +6,7 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <algorithm>            // max()
 #include <cerrno>
 #include <cstddef>              // byte
 #include <stdexcept>
@@ -18,6 +19,8 @@
 
 #include "socket.hpp"
 
+#include "io_slots.hpp"
+
 
 // Note: WUT doesn't have SOL_IP, but IPPROTO_IP seems to work.
 #ifndef SOL_IP
@@ -621,10 +624,19 @@ namespace net {
     }
 
 
+    int
+    socket::get_fd()
+        const noexcept
+    {
+        return fd;
+    }
+
+
     std::size_t
     socket::send(const void* buf, std::size_t len,
                  msg_flags flags)
     {
+        io_slots::guard slot;
         auto status = ::send(fd, buf, len, static_cast<int>(flags));
         if (status == -1)
             throw error{errno};
@@ -664,6 +676,7 @@ namespace net {
                    msg_flags flags)
     {
         auto raw_dst = dst.data();
+        io_slots::guard slot;
         auto status = ::sendto(fd,
                                buf, len,
                                static_cast<int>(flags),
@@ -843,6 +856,17 @@ namespace net {
                      std::chrono::milliseconds timeout)
         const noexcept
     {
+        // Waiting for a slot counts towards the timeout.
+        const auto start = std::chrono::steady_clock::now();
+        io_slots::guard slot{timeout};
+        if (!slot)
+            return std::unexpected{error{EBUSY}}; // not polled, unlike a timeout
+        if (timeout > timeout.zero()) {
+            auto waited = std::chrono::ceil<std::chrono::milliseconds>(
+                              std::chrono::steady_clock::now() - start);
+            timeout = std::max(timeout - waited, timeout.zero());
+        }
+
         pollfd pf{ fd, static_cast<int>(flags), 0 };
         int status = ::poll(&pf, 1, timeout.count());
         if (status == -1)
@@ -909,6 +933,7 @@ namespace net {
                      msg_flags flags)
         noexcept
     {
+        io_slots::guard slot;
         auto status = ::send(fd, buf, len, static_cast<int>(flags));
         if (status == -1)
             return std::unexpected{error{errno}};
@@ -923,6 +948,7 @@ namespace net {
         noexcept
     {
         auto raw_dst = dst.data();
+        io_slots::guard slot;
         auto status = ::sendto(fd,
                                buf, len,
                                static_cast<int>(flags),
@@ -232,6 +232,9 @@ namespace net {
         // Disassociate the handle from this socket.
         int release() noexcept;
 
+        // The handle, to poll many sockets at once.
+        int get_fd() const noexcept;
+
 
         std::size_t
         send(const void* buf, std::size_t len,
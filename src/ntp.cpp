@@ -6,16 +6,77 @@
  * SPDX-License-Identifier: MIT
  */
 
-#include <bit>                  // endian, byteswap()
 #include <cmath>                // ldexp()
 
-#include <sys/endian.h>         // be64toh(), htobe64()
-
 #include "ntp.hpp"
 
 
+using namespace std::literals;
+
+
 namespace ntp {
 
+    namespace {
+
+        // Compile-time checks for the fixed-point arithmetic.
+
+        constexpr std::uint64_t one_second = 0x1'0000'0000;
+
+        // 2036-02-07 06:28:15.5, half a second before the end of Era 0
+        constexpr auto era0_end = timestamp::from_raw(0xffff'ffff'8000'0000);
+        // 2036-02-07 06:28:16.5, half a second after the start of Era 1
+        constexpr auto era1_start = timestamp::from_raw(0x0000'0000'8000'0000);
+
+        static_assert(era1_start - era0_end == 1s);
+        static_assert(era0_end - era1_start == -1s);
+        static_assert(era0_end - era0_end == 0s);
+
+        // Local clock still in Era 0, server already in Era 1.
+        constexpr auto t1 = era0_end;
+        constexpr auto t2 = timestamp::from_raw(era1_start.load() + one_second / 4);
+        constexpr auto t3 = timestamp::from_raw(era1_start.load() + one_second / 2);
+        constexpr auto t4 = timestamp::from_raw(era0_end.load() + one_second / 2);
+        static_assert(roundtrip_delay(t1, t2, t3, t4) == 250ms);
+        static_assert(clock_offset(t1, t2, t3, t4) == 1125ms);
+        // Same exchange, but from the server's point of view.
+        static_assert(clock_offset(t2, t1, t4, t3) == -1125ms);
+
+        // Local clock wrapped to Era 1 ahead of the server, still in Era 0.
+        constexpr auto u1 = timestamp::from_raw(era1_start.load() + 3 * one_second);
+        constexpr auto u2 = timestamp::from_raw(era0_end.load() - one_second);
+        constexpr auto u3 = u2;
+        constexpr auto u4 = u1;
+        static_assert(roundtrip_delay(u1, u2, u3, u4) == 0s);
+        static_assert(clock_offset(u1, u2, u3, u4) == -5s);
+
+        // Offsets near the 68-year limit must not overflow.
+        constexpr auto max_diff = timestamp::from_raw(0x7fff'ffff'ffff'ffff);
+        static_assert(clock_offset(timestamp{}, max_diff, max_diff, timestamp{})
+                      == fixed_seconds{0x7fff'ffff'ffff'ffff});
+
+        // Resolution is 2^-32 seconds.
+        constexpr auto tick = timestamp::from_raw(1);
+        static_assert(tick - timestamp{} == fixed_seconds{1});
+
+        constexpr
+        short_timestamp
+        short_from_raw(std::uint32_t v)
+            noexcept
+        {
+            short_timestamp result;
+            result.store(v);
+            return result;
+        }
+
+        // Short timestamps (root delay and dispersion) convert exactly, up to 65536 s.
+        static_assert(static_cast<fixed_seconds>(short_from_raw(0x0001'8000)) == 1500ms);
+        static_assert(static_cast<fixed_seconds>(short_from_raw(1)) == fixed_seconds{0x1'0000});
+        static_assert(static_cast<fixed_seconds>(short_from_raw(0xffff'ffff))
+                      == fixed_seconds{0xffff'ffff'0000});
+
+    } // namespace
+
+
     timestamp::timestamp(dbl_seconds s)
         noexcept
     {
@@ -34,27 +95,29 @@ namespace ntp {
     }
 
 
-    std::uint64_t
-    timestamp::load()
+    std::strong_ordering
+    timestamp::operator <=>(timestamp other)
         const noexcept
     {
-        return be64toh(stored);
+        return load() <=> other.load();
     }
 
 
-    void
-    timestamp::store(std::uint64_t v)
+    short_timestamp::short_timestamp(dbl_seconds s)
         noexcept
     {
-        stored = htobe64(v);
+        // shift s to the left by 16 bits, to line up the fixed point
+        std::uint32_t shifted_s = std::ldexp(s.count(), 16);
+        store(shifted_s);
     }
 
 
-    std::strong_ordering
-    timestamp::operator <=>(timestamp other)
+    short_timestamp::operator dbl_seconds()
         const noexcept
     {
-        return load() <=> other.load();
+        // shift to the right by 16 bits
+        double s = std::ldexp(static_cast<double>(load()), -16);
+        return dbl_seconds{s};
     }
 
 
@@ -96,7 +159,7 @@ namespace ntp {
     packet::leap()
         const noexcept
     {
-        return static_cast<leap_flag>((lvm & 0b1100'0000) >> 6);
+        return static_cast<leap_flag>(lvm & 0b1100'0000);
     }
 
 
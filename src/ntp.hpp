@@ -9,8 +9,12 @@
 #ifndef NTP_HPP
 #define NTP_HPP
 
+#include <bit>                  // byteswap(), endian
+#include <chrono>
 #include <compare>
+#include <concepts>             // unsigned_integral
 #include <cstdint>
+#include <ratio>
 #include <string>
 
 #include "time_utils.hpp"
@@ -23,6 +27,28 @@ namespace ntp {
     using time_utils::dbl_seconds;
 
 
+    // Signed 32.32 fixed-point seconds, the result of subtracting timestamps.
+    using fixed_seconds = std::chrono::duration<std::int64_t, std::ratio<1, 0x1'0000'0000>>;
+
+
+    namespace detail {
+
+        // Network (big-endian) <-> native byte order.
+        template<std::unsigned_integral T>
+        constexpr
+        T
+        swap_be(T v)
+            noexcept
+        {
+            if constexpr (std::endian::native == std::endian::little)
+                return std::byteswap(v);
+            else
+                return v;
+        }
+
+    } // namespace detail
+
+
     // This is u32.32 fixed-point format, seconds since 1900-01-01 00:00:00 UTC
     class timestamp {
 
@@ -34,6 +60,17 @@ namespace ntp {
 
         timestamp(std::uint64_t v) = delete;
 
+        // Named constructor, from a native u32.32 value.
+        static constexpr
+        timestamp
+        from_raw(std::uint64_t v)
+            noexcept
+        {
+            timestamp result;
+            result.store(v);
+            return result;
+        }
+
         // Allow explicit conversions from/to dbl_seconds
         explicit timestamp(dbl_seconds d) noexcept;
         explicit operator dbl_seconds() const noexcept;
@@ -43,8 +80,8 @@ namespace ntp {
 
 
         // These will byteswap if necessary.
-        std::uint64_t load() const noexcept;
-        void store(std::uint64_t v) noexcept;
+        constexpr std::uint64_t load() const noexcept { return detail::swap_be(stored); }
+        constexpr void store(std::uint64_t v) noexcept { stored = detail::swap_be(v); }
 
 
         constexpr
@@ -53,13 +90,86 @@ namespace ntp {
         std::strong_ordering operator <=>(timestamp other) const noexcept;
 
     };
-    // TODO: implement difference calculations for timestamps, as recommended by the RFC.
-    // Differences sould be done in fixed-point, should check for overflows, and return
-    // floating-point.
 
 
-    // This is a u16.16 fixed-point format.
-    using short_timestamp = std::uint32_t;
+    /*
+     * Difference between timestamps, as recommended by RFC 5905: the subtraction is done
+     * modulo 2^64, so the result is correct across era boundaries, as long as both
+     * timestamps are less than 68 years apart.
+     */
+    constexpr
+    fixed_seconds
+    operator -(timestamp a, timestamp b)
+        noexcept
+    {
+        return fixed_seconds{static_cast<std::int64_t>(a.load() - b.load())};
+    }
+
+
+    /*
+     * Clock offset: ((t2 - t1) + (t3 - t4)) / 2
+     *
+     *   t1: when the client sent the request (client clock)
+     *   t2: when the server received the request (server clock)
+     *   t3: when the server sent the response (server clock)
+     *   t4: when the client received the response (client clock)
+     */
+    constexpr
+    fixed_seconds
+    clock_offset(timestamp t1, timestamp t2, timestamp t3, timestamp t4)
+        noexcept
+    {
+        std::int64_t a = (t2 - t1).count();
+        std::int64_t b = (t3 - t4).count();
+        // floor((a + b) / 2), without overflowing
+        return fixed_seconds{(a >> 1) + (b >> 1) + (a & b & 1)};
+    }
+
+
+    // Round-trip delay: (t4 - t1) - (t3 - t2)
+    constexpr
+    fixed_seconds
+    roundtrip_delay(timestamp t1, timestamp t2, timestamp t3, timestamp t4)
+        noexcept
+    {
+        return (t4 - t1) - (t3 - t2);
+    }
+
+
+    // This is a u16.16 fixed-point format, used for durations.
+    class short_timestamp {
+
+        std::uint32_t stored = 0; // in big-endian format
+
+    public:
+
+        constexpr short_timestamp() noexcept = default;
+
+        short_timestamp(std::uint32_t v) = delete;
+
+        // Allow explicit conversions from/to dbl_seconds
+        explicit short_timestamp(dbl_seconds d) noexcept;
+        explicit operator dbl_seconds() const noexcept;
+
+        // Exact conversion, from u16.16 to 32.32.
+        constexpr
+        explicit
+        operator fixed_seconds()
+            const noexcept
+        {
+            return fixed_seconds{static_cast<std::int64_t>(load()) << 16};
+        }
+
+
+        // These will byteswap if necessary.
+        constexpr std::uint32_t load() const noexcept { return detail::swap_be(stored); }
+        constexpr void store(std::uint32_t v) noexcept { stored = detail::swap_be(v); }
+
+
+        constexpr
+        bool operator ==(const short_timestamp& other) const noexcept = default;
+
+    };
 
 
     // Note: all fields are big-endian
@@ -90,8 +200,8 @@ namespace ntp {
         std::int8_t  poll_exp      = 0; // Maximum interval between successive messages.
         std::int8_t  precision_exp = 0; // Precision of the local clock.
 
-        short_timestamp root_delay      = 0; // Total round trip delay time to the reference clock.
-        short_timestamp root_dispersion = 0; // Total dispersion to the reference clock.
+        short_timestamp root_delay;      // Total round trip delay time to the reference clock.
+        short_timestamp root_dispersion; // Total dispersion to the reference clock.
         char            reference_id[4] = {0, 0, 0, 0}; // Reference clock identifier.
 
         timestamp reference_time; // Reference timestamp.
@@ -0,0 +1,447 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>            // clamp(), max(), min(), ranges::*
+#include <cctype>               // isalnum()
+#include <cmath>                // sqrt()
+#include <stdexcept>            // runtime_error
+#include <system_error>         // errc
+#include <utility>              // exchange(), move()
+
+#include "ntp_client.hpp"
+
+#include "reactor.hpp"
+#include "utc.hpp"
+
+
+using namespace std::literals;
+using std::runtime_error;
+
+
+namespace ntp {
+
+    namespace {
+
+        constexpr unsigned max_send_attempts = 4;
+        constexpr auto send_retry_delay = 100ms;
+
+        // Don't flood the server if a bogus retransmission timeout is given.
+        constexpr std::chrono::milliseconds min_rto = 100ms;
+
+        // Retransmissions of each request, if the timeout allows.
+        constexpr unsigned max_retransmissions = 2;
+
+
+        bool
+        would_block(const net::error& e)
+            noexcept
+        {
+            return e.code() == std::errc::operation_would_block
+                || e.code() == std::errc::resource_unavailable_try_again;
+        }
+
+
+        // The server told us to go away, see RFC 5905, section 7.4.
+        struct kiss_error : runtime_error {
+
+            std::string code;
+
+            kiss_error(const std::string& code) :
+                runtime_error{"Kiss-o'-Death: " + code},
+                code{code}
+            {}
+
+        };
+
+
+        // The kiss code is a 4 letter ASCII string in the reference id.
+        std::string
+        kiss_code(const packet& pkt)
+        {
+            std::string code;
+            for (char c : pkt.reference_id) {
+                if (!c)
+                    break;
+                code += std::isalnum(static_cast<unsigned char>(c)) ? c : '?';
+            }
+            return code;
+        }
+
+
+        /*
+         * Validate the server response, and calculate the clock correction.
+         *
+         * The round-trip time is measured with the monotonic clock, so it's not affected if
+         * the wall clock is changed during the exchange. Only t4 is taken from the wall clock,
+         * to find the offset.
+         */
+        sample
+        analyze(const packet& pkt,
+                timestamp t4,
+                fixed_seconds local_roundtrip)
+        {
+            using std::to_string;
+
+            auto v = pkt.version();
+            if (v < 3 || v > 4)
+                throw runtime_error{"Unsupported NTP version: "s + to_string(v)};
+
+            auto m = pkt.mode();
+            if (m != packet::mode_flag::server)
+                throw runtime_error{"Invalid NTP packet mode: "s + to_string(m)};
+
+            // Note: Kiss-o'-Death packets also have the leap flag set to "unknown".
+            if (pkt.stratum == 0)
+                throw kiss_error{kiss_code(pkt)};
+
+            auto l = pkt.leap();
+            if (l == packet::leap_flag::unknown)
+                throw runtime_error{"Unknown value for leap flag."};
+
+            // when our request arrived at the server
+            auto t2 = pkt.receive_time;
+            // when the server sent out a response
+            auto t3 = pkt.transmit_time;
+
+            // Zero is not a valid timestamp.
+            if (!t2 || !t3)
+                throw runtime_error{"NTP response has invalid timestamps."};
+
+            // All calculations are done in fixed-point, era wraparounds are handled too.
+            // This is roundtrip_delay(t1, t2, t3, t4), with t4 - t1 from the monotonic clock.
+            fixed_seconds roundtrip = local_roundtrip - (t3 - t2);
+            // The server's clock might tick slightly faster than ours.
+            if (roundtrip < fixed_seconds::zero())
+                roundtrip = fixed_seconds::zero();
+            fixed_seconds latency = roundtrip / 2;
+
+            // t4 + correction = t3 + latency
+            fixed_seconds correction = (t3 - t4) + latency;
+
+            sample result{ correction, latency };
+            result.root_delay = static_cast<fixed_seconds>(pkt.root_delay);
+            result.root_dispersion = static_cast<fixed_seconds>(pkt.root_dispersion);
+            result.stratum = pkt.stratum;
+            result.poll_exp = pkt.poll_exp;
+            return result;
+        }
+
+
+        /*
+         * Pick the sample with the lowest round-trip time, and calculate the jitter as the
+         * RMS difference between its correction and all the others, as in RFC 5905.
+         */
+        std::expected<sample, std::string>
+        combine(const std::vector<sample>& samples,
+                const std::string& error)
+        {
+            if (samples.empty())
+                return std::unexpected{error};
+
+            sample best = *std::ranges::min_element(samples, {}, &sample::latency);
+            if (samples.size() > 1) {
+                double sum = 0;
+                for (auto& s : samples) {
+                    double d = dbl_seconds{s.correction - best.correction}.count();
+                    sum += d * d;
+                }
+                // Note: squares of 32.32 values overflow, so the RMS is done in floating-point;
+                // the result is stored in fixed-point.
+                dbl_seconds rms{std::sqrt(sum / (samples.size() - 1))};
+                best.jitter = std::chrono::round<fixed_seconds>(rms);
+            }
+            return best;
+        }
+
+    } // namespace
+
+
+    fixed_seconds
+    root_distance(const sample& s)
+        noexcept
+    {
+        // Minimum dispersion increment, to avoid trusting a near-zero distance too much.
+        constexpr auto min_dispersion = std::chrono::duration_cast<fixed_seconds>(10ms);
+        fixed_seconds delay = 2 * s.latency + s.root_delay;
+        return std::max(min_dispersion, delay) / 2 + s.root_dispersion + s.jitter;
+    }
+
+
+    client::client(const options& opts) :
+        sock{net::socket::type::udp},
+        opts(opts)
+    {}
+
+
+    void
+    client::add(net::address address,
+                std::chrono::milliseconds rto)
+    {
+        auto [b, inserted] = bursts.try_emplace(address);
+        if (!inserted)
+            return; // this address is already being queried
+
+        rto = std::max(rto, min_rto);
+        // The RTO doubles after every send, so the last retransmission times out after
+        // rto * (2^(n+1) - 1), for n retransmissions.
+        const auto patience = rto * ((2u << max_retransmissions) - 1);
+
+        const auto now = clock::now();
+        const auto deadline = now + opts.timeout;
+        for (unsigned i = 0; i < std::max(opts.burst_size, 1u); ++i) {
+            auto send_time = now + i * opts.burst_interval;
+            // Don't schedule requests that could not be answered in time.
+            if (i > 0 && send_time >= deadline)
+                break;
+            exchange ex;
+            ex.address = address;
+            ex.send_time = send_time;
+            ex.rto = rto;
+            ex.deadline = std::min(send_time + patience, deadline);
+            exchanges.push_back(ex);
+            ++b->second.pending;
+        }
+    }
+
+
+    bool
+    client::empty()
+        const noexcept
+    {
+        return exchanges.empty();
+    }
+
+
+    void
+    client::cancel()
+    {
+        exchanges.clear();
+        bursts.clear();
+        finished.clear();
+        late_addresses.clear();
+        sock.close();
+    }
+
+
+    bool
+    client::drop(net::address address)
+    {
+        if (!bursts.erase(address))
+            return false;
+        std::erase_if(exchanges, [address](const exchange& ex) { return ex.address == address; });
+        std::erase(late_addresses, address);
+        return true;
+    }
+
+
+    std::vector<net::address>
+    client::take_late()
+    {
+        return std::exchange(late_addresses, {});
+    }
+
+
+    std::vector<client::exchange>::iterator
+    client::finish(std::vector<exchange>::iterator it,
+                   std::expected<sample, std::string> value)
+    {
+        auto b = bursts.find(it->address);
+        if (value)
+            b->second.samples.push_back(*value);
+        else
+            b->second.error = std::move(value.error());
+
+        if (!--b->second.pending) {
+            finished.push_back({ b->first,
+                                 combine(b->second.samples, b->second.error),
+                                 b->second.kiss_code });
+            bursts.erase(b);
+            std::erase(late_addresses, it->address);
+        }
+
+        return exchanges.erase(it);
+    }
+
+
+    void
+    client::send_pending(clock::time_point now)
+    {
+        packet pkt;
+        pkt.version(4);
+        pkt.mode(packet::mode_flag::client);
+
+        for (auto it = exchanges.begin(); it != exchanges.end();) {
+            if (now < (it->sent ? it->retransmit_time : it->send_time)) {
+                ++it;
+                continue;
+            }
+
+            auto m1 = utc::monotonic_ticks();
+            auto t1 = utc::to_ntp(utc::now());
+            pkt.transmit_time = t1;
+            auto status = sock.try_sendto(&pkt, sizeof pkt, it->address);
+            ++it->send_attempts;
+
+            if (it->sent) {
+                auto& b = bursts.at(it->address);
+                if (!b.late) {
+                    b.late = true;
+                    late_addresses.push_back(it->address);
+                }
+            }
+
+            // Back off, whether it was sent or not.
+            if (status || it->sent) {
+                if (status)
+                    it->transmissions.push_back({ t1, m1 });
+                it->sent = true;
+                it->retransmit_time = now + it->rto;
+                it->rto *= 2;
+                ++it;
+                continue;
+            }
+
+            // The Wii U OS may run out of buffers, so we may need to try again later. Note:
+            // our own sockets can't cause this anymore (see net/io_slots.hpp), but other
+            // plugins and the running application share the same limit.
+            auto& e = status.error();
+            if (e.code() != std::errc::not_enough_memory) {
+                it = finish(it, std::unexpected{e.what()});
+                continue;
+            }
+            if (it->send_attempts >= max_send_attempts) {
+                it = finish(it, std::unexpected{"No resources for sendto(), too many retries!"s});
+                continue;
+            }
+            it->send_time = now + send_retry_delay;
+            ++it;
+        }
+    }
+
+
+    void
+    client::receive_all()
+    {
+        packet pkt;
+
+        for (;;) {
+            auto status = sock.try_recvfrom(&pkt, sizeof pkt,
+                                            net::socket::msg_flags::dontwait);
+            // Measure the arrival time as soon as possible.
+            auto m4 = utc::monotonic_ticks();
+            auto t4 = utc::to_ntp(utc::now());
+            if (!status) {
+                if (would_block(status.error()))
+                    return;
+                throw status.error();
+            }
+
+            auto [size, source] = *status;
+            // Ignore anything that isn't a full NTP packet.
+            if (size < sizeof pkt)
+                continue;
+
+            // Ignore stray packets, like duplicated or late replies. A reply to any
+            // transmission is accepted, the round-trip is measured from that one.
+            const transmission* tx = nullptr;
+            auto it = std::ranges::find_if(exchanges,
+                                           [&pkt, source, &tx](const exchange& ex)
+                                           {
+                                               if (ex.address != source)
+                                                   return false;
+                                               for (auto& t : ex.transmissions)
+                                                   if (t.origin == pkt.origin_time) {
+                                                       tx = &t;
+                                                       return true;
+                                                   }
+                                               return false;
+                                           });
+            if (it == exchanges.end())
+                continue;
+
+            try {
+                auto local_roundtrip = utc::from_ticks(m4 - tx->mono_origin);
+                finish(it, analyze(pkt, t4, local_roundtrip));
+            }
+            catch (kiss_error& e) {
+                // Don't send anything else to this address.
+                bursts.at(source).kiss_code = e.code;
+                for (auto ex = exchanges.begin(); ex != exchanges.end();)
+                    if (ex->address == source)
+                        ex = finish(ex, std::unexpected{e.what()});
+                    else
+                        ++ex;
+            }
+            catch (std::exception& e) {
+                finish(it, std::unexpected{e.what()});
+            }
+        }
+    }
+
+
+    void
+    client::expire(clock::time_point now)
+    {
+        for (auto it = exchanges.begin(); it != exchanges.end();) {
+            if (now >= it->deadline)
+                it = finish(it, std::unexpected{"Timeout reached!"s});
+            else
+                ++it;
+        }
+    }
+
+
+    coro::task<std::vector<client::result>>
+    client::process_async(std::chrono::milliseconds max_wait,
+                          std::stop_token token)
+    {
+        auto now = clock::now();
+        send_pending(now);
+        expire(now);
+
+        if (!exchanges.empty()) {
+            // Wake up for the next deadline, or the next scheduled send.
+            auto next = clock::time_point::max();
+            for (auto& ex : exchanges)
+                next = std::min(next,
+                                ex.sent
+                                ? std::min(ex.deadline, ex.retransmit_time)
+                                : ex.send_time);
+            auto wait = std::chrono::ceil<std::chrono::milliseconds>(next - now);
+            wait = std::clamp(wait, 0ms, max_wait);
+
+            // Note: the reactor already handles the Wii U limit of 16 concurrent
+            // select()/poll() calls.
+            auto readable = co_await reactor::readable(sock, wait, token);
+            if (!readable) {
+                // Stopped: the caller checks its own token.
+                if (token.stop_requested())
+                    co_return std::exchange(finished, {});
+                // Not polled, for lack of a poll slot. Receiving doesn't need one, so
+                // replies that already arrived are not counted as lost.
+                if (readable.error().code() != std::errc::device_or_resource_busy)
+                    throw readable.error();
+                receive_all();
+            } else if (*readable)
+                receive_all();
+
+            expire(clock::now());
+        }
+
+        co_return std::exchange(finished, {});
+    }
+
+
+    std::vector<client::result>
+    client::process(std::chrono::milliseconds max_wait,
+                    std::stop_token token)
+    {
+        return coro::spawn(process_async(max_wait, std::move(token))).get();
+    }
+
+} // namespace ntp
@@ -0,0 +1,196 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef NTP_CLIENT_HPP
+#define NTP_CLIENT_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <expected>
+#include <map>
+#include <stop_token>
+#include <string>
+#include <vector>
+
+#include "coro.hpp"
+#include "net/address.hpp"
+#include "net/socket.hpp"
+#include "ntp.hpp"
+#include "time_utils.hpp"
+
+
+namespace ntp {
+
+    using time_utils::dbl_seconds;
+
+
+    // The outcome of querying one NTP server.
+    struct sample {
+        fixed_seconds correction;         // how much the local clock must be adjusted
+        fixed_seconds latency;            // half the round-trip time
+        fixed_seconds jitter{0};          // RMS spread of the corrections in a burst
+        fixed_seconds root_delay{0};      // from the server to its reference clock
+        fixed_seconds root_dispersion{0}; // from the server to its reference clock
+        unsigned      stratum = 0;
+        int           poll_exp = 0;       // log2 of the poll interval the server asks for
+    };
+
+
+    // Maximum error of the sample's correction, as defined in RFC 5905.
+    fixed_seconds root_distance(const sample& s) noexcept;
+
+
+    /*
+     * Queries many NTP servers concurrently, from a single thread.
+     *
+     * All requests are sent from one unconnected UDP socket; replies are matched back to
+     * their requests by source address and origin timestamp. A single poll() is used to
+     * wait on all of them, so the Wii U's limit of 16 concurrent poll() calls is never an
+     * issue here.
+     *
+     * Each address can be sent a burst of spaced requests; like the RFC 5905 clock filter,
+     * only the reply with the lowest round-trip time is kept, since it's the one that
+     * suffered the least queuing delay.
+     */
+    class client {
+
+    public:
+
+        using clock = std::chrono::steady_clock;
+
+
+        struct options {
+            std::chrono::milliseconds timeout;        // for the whole burst
+            unsigned                  burst_size;     // how many requests per address
+            std::chrono::milliseconds burst_interval; // spacing between requests
+        };
+
+
+        struct result {
+            net::address address;
+            std::expected<sample, std::string> value;
+            std::string kiss_code; // set if the server sent a Kiss-o'-Death
+        };
+
+
+    private:
+
+        // One transmission of a request; retransmissions get a fresh origin.
+        struct transmission {
+            timestamp origin;         // our transmit time, echoed back by the server
+            std::int64_t mono_origin; // monotonic clock ticks when sent
+        };
+
+        // A single request/reply pair.
+        struct exchange {
+            net::address address;
+            std::vector<transmission> transmissions;
+            clock::time_point send_time; // when to send, or try sending again
+            clock::time_point retransmit_time; // when to send again, if there's no reply
+            clock::duration rto; // retransmission timeout, doubles after every send
+            clock::time_point deadline;
+            unsigned send_attempts = 0;
+            bool sent = false;
+        };
+
+        // All the exchanges with one address.
+        struct burst {
+            unsigned pending = 0;
+            std::vector<sample> samples;
+            std::string error;
+            std::string kiss_code;
+            bool late = false;
+        };
+
+        net::socket sock;
+        options opts;
+        std::vector<exchange> exchanges;
+        std::map<net::address, burst> bursts;
+        std::vector<result> finished;
+        std::vector<net::address> late_addresses;
+
+
+        void send_pending(clock::time_point now);
+        void receive_all();
+        void expire(clock::time_point now);
+
+        // Removes the exchange, returns the next one.
+        std::vector<exchange>::iterator
+        finish(std::vector<exchange>::iterator it,
+               std::expected<sample, std::string> value);
+
+    public:
+
+        explicit
+        client(const options& opts);
+
+
+        /*
+         * Schedule a burst of queries; they will be sent by process().
+         *
+         * Each request is sent again, with exponential backoff, if there's no reply within
+         * the retransmission timeout (see scorecard::retransmit_timeout()). A request is
+         * given up after its last retransmission times out, or when opts.timeout is
+         * reached, whichever comes first.
+         */
+        void add(net::address address,
+                 std::chrono::milliseconds rto);
+
+
+        // True if there are no queries waiting for a reply.
+        bool empty() const noexcept;
+
+
+        // Abandon all queries, and close the socket. No more results will be returned.
+        void cancel();
+
+
+        /*
+         * Abandon the queries to one address; no result will be returned for it.
+         *
+         * Returns false if there's nothing to abandon, because it already finished.
+         */
+        bool drop(net::address address);
+
+
+        /*
+         * Addresses that didn't reply to their first request within the retransmission
+         * timeout, and are still being queried; each address is only returned once.
+         */
+        std::vector<net::address> take_late();
+
+
+        /*
+         * Send scheduled queries, and wait up to max_wait for replies; the wait ends early
+         * if a stop is requested through the token.
+         *
+         * Returns the addresses whose burst finished, either successfully or not.
+         */
+        coro::task<std::vector<result>>
+        process_async(std::chrono::milliseconds max_wait,
+                      std::stop_token token = {});
+
+
+        /*
+         * Same as process_async(), but blocks the calling thread, up to max_wait.
+         *
+         * Note: core::run() and the clock item use this, so a sync still parks the one
+         * thread that runs it, as before. What changed is that all exchanges share that
+         * thread and a single socket, instead of one thread per server. They can't await
+         * process_async() themselves: the coroutine resumes on the reactor thread, and the
+         * rest of their loop (DNS waits, notifications, files) would block it.
+         */
+        std::vector<result>
+        process(std::chrono::milliseconds max_wait,
+                std::stop_token token = {});
+
+    };
+
+} // namespace ntp
+
+#endif
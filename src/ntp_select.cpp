@@ -0,0 +1,133 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>            // max(), ranges::sort()
+#include <ranges>               // views::reverse
+
+#include "ntp_select.hpp"
+
+
+namespace ntp {
+
+    namespace {
+
+        // Each correctness interval contributes 2 endpoints.
+        struct endpoint {
+            dbl_seconds value;
+            int type; // -1 = lower, +1 = upper
+
+            // Note: on ties, lower ends come first, so touching intervals overlap.
+            constexpr auto operator <=>(const endpoint&) const noexcept = default;
+        };
+
+    } // namespace
+
+
+    std::optional<selection>
+    select(std::span<const candidate> candidates)
+    {
+        const std::size_t n = candidates.size();
+        if (n == 0)
+            return {};
+
+        std::vector<endpoint> edges;
+        edges.reserve(2 * n);
+        for (auto& c : candidates) {
+            edges.push_back({ c.offset - c.distance, -1 });
+            edges.push_back({ c.offset + c.distance, +1 });
+        }
+        std::ranges::sort(edges);
+
+        // First, find how many intervals overlap at the best point.
+        std::size_t best = 0;
+        std::size_t chime = 0;
+        for (auto& e : edges) {
+            if (e.type < 0)
+                best = std::max(best, ++chime);
+            else
+                --chime;
+        }
+
+        // The truechimers must be a majority, otherwise we can't tell who is right.
+        if (2 * best <= n)
+            return {};
+
+        selection result{};
+
+        // The lowest point covered by that many intervals.
+        chime = 0;
+        for (auto& e : edges) {
+            if (e.type < 0) {
+                if (++chime == best) {
+                    result.low = e.value;
+                    break;
+                }
+            } else
+                --chime;
+        }
+
+        // The highest point covered by that many intervals.
+        chime = 0;
+        for (auto& e : edges | std::views::reverse) {
+            if (e.type > 0) {
+                if (++chime == best) {
+                    result.high = e.value;
+                    break;
+                }
+            } else
+                --chime;
+        }
+
+        // Candidates whose interval misses the intersection are falsetickers.
+        for (std::size_t i = 0; i < n; ++i) {
+            auto& c = candidates[i];
+            if (c.offset - c.distance <= result.high && c.offset + c.distance >= result.low)
+                result.survivors.push_back(i);
+        }
+
+        return result;
+    }
+
+
+    estimate
+    combine(std::span<const candidate> candidates,
+            const selection& sel)
+    {
+        // Avoid dividing by zero, for servers that claim to be perfect.
+        constexpr dbl_seconds min_distance{1e-6};
+
+        double weights = 0;
+        dbl_seconds total{0};
+        for (auto i : sel.survivors) {
+            double w = 1 / std::max(candidates[i].distance, min_distance).count();
+            weights += w;
+            total += w * candidates[i].offset;
+        }
+
+        estimate result;
+        result.offset = total / weights;
+        result.error = std::max(result.offset - sel.low, sel.high - result.offset);
+        return result;
+    }
+
+
+    dbl_seconds
+    spread(std::span<const candidate> candidates,
+           const selection& sel)
+    {
+        if (sel.survivors.empty())
+            return dbl_seconds{0};
+        auto [lo, hi] = std::ranges::minmax(sel.survivors
+                                            | std::views::transform([candidates](std::size_t i)
+                                                                    {
+                                                                        return candidates[i].offset;
+                                                                    }));
+        return hi - lo;
+    }
+
+} // namespace ntp
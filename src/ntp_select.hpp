@@ -0,0 +1,81 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef NTP_SELECT_HPP
+#define NTP_SELECT_HPP
+
+#include <cstddef>              // size_t
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "time_utils.hpp"
+
+
+/*
+ * Clock selection, as described in RFC 5905, section 11.2.1.
+ *
+ * Note: this code is platform-independent, so it can be tested and benchmarked on a PC.
+ */
+
+namespace ntp {
+
+    using time_utils::dbl_seconds;
+
+
+    struct candidate {
+        dbl_seconds offset;   // the clock correction
+        dbl_seconds distance; // the root distance; the true offset is within offset ± distance
+    };
+
+
+    struct selection {
+        // The intersection of the correctness intervals from the majority of candidates.
+        dbl_seconds low;
+        dbl_seconds high;
+
+        // Indexes of the candidates that agree with the majority (the "truechimers").
+        std::vector<std::size_t> survivors;
+    };
+
+
+    /*
+     * Find the intersection of the largest number of correctness intervals (Marzullo's
+     * algorithm), in O(n log n) time.
+     *
+     * Returns an empty optional if no majority of candidates agree.
+     */
+    std::optional<selection>
+    select(std::span<const candidate> candidates);
+
+
+    struct estimate {
+        dbl_seconds offset; // the clock correction
+        dbl_seconds error;  // the true offset is within offset ± error
+    };
+
+
+    /*
+     * Combine the survivors into a single clock correction, weighting each one by the
+     * inverse of its root distance, as in RFC 5905, section 11.2.3.
+     *
+     * The error bound comes from the selection: the true offset is inside the intersection.
+     */
+    estimate
+    combine(std::span<const candidate> candidates,
+            const selection& sel);
+
+
+    // How far apart the survivors' offsets are.
+    dbl_seconds
+    spread(std::span<const candidate> candidates,
+           const selection& sel);
+
+} // namespace ntp
+
+#endif
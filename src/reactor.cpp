@@ -0,0 +1,353 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>            // clamp(), erase_if(), min()
+#include <cerrno>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <netinet/in.h>         // INADDR_LOOPBACK
+#include <poll.h>
+#include <sys/socket.h>         // send(), MSG_DONTWAIT
+
+#include <wupsxx/logger.hpp>
+
+#include "reactor.hpp"
+
+#include "net/io_slots.hpp"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+
+using namespace std::literals;
+
+namespace logger = wups::logger;
+
+
+namespace reactor {
+
+    namespace {
+
+        // Without a wakeup socket, new waits are only noticed between poll() calls, so
+        // don't poll for too long.
+        constexpr auto fallback_poll_time = 10ms;
+
+        // With a wakeup socket, this only keeps the poll() timeout in range.
+        constexpr auto max_poll_time = 1h;
+
+        // If the OS has no poll slot for us, try again after this.
+        constexpr auto busy_delay = 10ms;
+
+
+        std::mutex mutex;
+        std::condition_variable_any cond; // wakes up the reactor if it's not polling
+        std::vector<wait_op*> incoming;
+        bool woken = false;
+        bool stopping = false;
+        std::jthread thread;
+
+        // A UDP socket connected to itself: sending to it wakes up poll(). Only changed
+        // while the thread is not running.
+        net::socket wakeup;
+
+
+        net::socket
+        make_wakeup_socket()
+        {
+            try {
+                auto s = net::socket::make_udp();
+                s.bind({ INADDR_LOOPBACK, 0 });
+                s.connect(s.getsockname());
+                s.set_nonblock(true);
+                return s;
+            }
+            catch (std::exception& e) {
+                logger::guard logger_guard{PACKAGE_NAME};
+                logger::printf("Reactor has no wakeup socket, polling instead: %s\n",
+                               e.what());
+                return {};
+            }
+        }
+
+
+        // Assumes the mutex is locked.
+        void
+        wake_locked()
+            noexcept
+        {
+            woken = true;
+            cond.notify_one();
+            if (wakeup) {
+                // Note: socket::try_send() would wait for an I/O slot; a non-blocking send
+                // to ourselves doesn't need one. If the buffer is full, poll() will return
+                // anyway.
+                char byte = 0;
+                ::send(wakeup.get_fd(), &byte, 1, MSG_DONTWAIT);
+            }
+        }
+
+
+        void
+        wake()
+            noexcept
+        {
+            std::lock_guard lock{mutex};
+            wake_locked();
+        }
+
+
+        void
+        drain_wakeup()
+            noexcept
+        {
+            char buf[64];
+            while (wakeup.try_recv(buf, sizeof buf, net::socket::msg_flags::dontwait))
+                ;
+        }
+
+
+        void
+        finish(wait_op* op,
+               std::expected<short, net::error> revents)
+        {
+            op->revents = std::move(revents);
+            op->handle.resume();
+        }
+
+
+        void
+        loop(std::stop_token token)
+        {
+            const auto poll_limit = wakeup ? max_poll_time : fallback_poll_time;
+            // The wakeup socket is always the first entry in fds.
+            const std::size_t first = wakeup ? 1 : 0;
+
+            std::vector<wait_op*> active;
+            std::vector<pollfd> fds;
+            std::vector<wait_op*> done;
+
+            for (;;) {
+                {
+                    std::unique_lock lock{mutex};
+                    if (active.empty())
+                        cond.wait(lock, token, [] { return woken; });
+                    woken = false;
+                    active.insert(active.end(), incoming.begin(), incoming.end());
+                    incoming.clear();
+                    if (token.stop_requested())
+                        break;
+                }
+
+                auto now = clock::now();
+                auto next = clock::time_point::max();
+                fds.clear();
+                if (wakeup)
+                    fds.push_back({ wakeup.get_fd(), POLLIN, 0 });
+                for (auto op : active) {
+                    next = std::min(next, op->deadline);
+                    if (op->fd >= 0)
+                        fds.push_back({ op->fd, op->events, 0 });
+                }
+                auto wait = std::chrono::ceil<std::chrono::milliseconds>(next - now);
+                wait = std::clamp<std::chrono::milliseconds>(wait, 0ms, poll_limit);
+
+                std::expected<int, net::error> status = 0;
+                if (fds.size() > first) {
+                    // Wakeups are not noticed while waiting for a slot, so don't wait long.
+                    net::io_slots::guard slot{std::min<std::chrono::milliseconds>(wait,
+                                                                                  busy_delay)};
+                    if (slot) {
+                        int s = ::poll(fds.data(), fds.size(), wait.count());
+                        if (s == -1)
+                            status = std::unexpected{net::error{errno}};
+                    } else
+                        status = std::unexpected{net::error{EBUSY}};
+                } else {
+                    // Only timers, sleep until the next one, or until woken up.
+                    std::unique_lock lock{mutex};
+                    cond.wait_for(lock, token, wait, [] { return woken; });
+                }
+
+                // Either way, the sockets were not polled.
+                bool busy = !status
+                    && (status.error().code() == std::errc::not_enough_memory
+                        || status.error().code() == std::errc::device_or_resource_busy);
+
+                if (first && status && fds[0].revents)
+                    drain_wakeup();
+
+                now = clock::now();
+                done.clear();
+                std::size_t i = first;
+                std::erase_if(active,
+                              [&](wait_op* op)
+                              {
+                                  const pollfd* pf = op->fd >= 0 ? &fds[i++] : nullptr;
+                                  if (op->canceled) {
+                                      op->revents = std::unexpected{net::error{ECANCELED}};
+                                      done.push_back(op);
+                                      return true;
+                                  }
+                                  if (pf) {
+                                      if (!status && !busy) {
+                                          op->revents = std::unexpected{status.error()};
+                                          done.push_back(op);
+                                          return true;
+                                      }
+                                      if (pf->revents) {
+                                          op->revents = pf->revents;
+                                          done.push_back(op);
+                                          return true;
+                                      }
+                                  }
+                                  if (now >= op->deadline) {
+                                      // Note: an unpolled socket didn't time out.
+                                      if (pf && busy)
+                                          op->revents = std::unexpected{net::error{EBUSY}};
+                                      else
+                                          op->revents = 0;
+                                      done.push_back(op);
+                                      return true;
+                                  }
+                                  return false;
+                              });
+
+                // Note: resumed coroutines may wait again, that only touches `incoming`.
+                for (auto op : done)
+                    op->handle.resume();
+
+                if (busy) {
+                    // Another plugin, or the application, is using all poll slots.
+                    std::unique_lock lock{mutex};
+                    cond.wait_for(lock, token, busy_delay, [] { return woken; });
+                }
+            }
+
+            for (auto op : active)
+                finish(op, std::unexpected{net::error{ECANCELED}});
+        }
+
+    } // namespace
+
+
+    void
+    wait_op::canceler::operator ()()
+        const noexcept
+    {
+        op->canceled = true;
+        wake();
+    }
+
+
+    wait_op::wait_op(int fd,
+                     short events,
+                     std::chrono::milliseconds timeout,
+                     std::stop_token token)
+        noexcept :
+        fd{fd},
+        events{events},
+        deadline{clock::now() + timeout},
+        token{std::move(token)}
+    {}
+
+
+    bool
+    wait_op::await_suspend(std::coroutine_handle<> h)
+    {
+        handle = h;
+        if (token.stop_requested()) {
+            revents = std::unexpected{net::error{ECANCELED}};
+            return false;
+        }
+        // Note: registered before the reactor can see this op. If a stop is requested
+        // from now on, the reactor finishes the op as soon as it sees it.
+        if (token.stop_possible())
+            on_stop.emplace(token, canceler{this});
+
+        std::lock_guard lock{mutex};
+        if (stopping) {
+            revents = std::unexpected{net::error{ECANCELED}};
+            return false;
+        }
+        incoming.push_back(this);
+        if (!thread.joinable()) {
+            if (!wakeup)
+                wakeup = make_wakeup_socket();
+            thread = std::jthread{loop};
+        }
+        wake_locked();
+        return true;
+    }
+
+
+    std::expected<bool, net::error>
+    wait_op::await_resume()
+        const noexcept
+    {
+        if (!revents)
+            return std::unexpected{revents.error()};
+        return (*revents & (events | POLLERR | POLLHUP | POLLNVAL)) != 0;
+    }
+
+
+    wait_op
+    readable(const net::socket& sock,
+             std::chrono::milliseconds timeout,
+             std::stop_token token)
+        noexcept
+    {
+        return { sock.get_fd(), POLLIN, timeout, std::move(token) };
+    }
+
+
+    wait_op
+    writable(const net::socket& sock,
+             std::chrono::milliseconds timeout,
+             std::stop_token token)
+        noexcept
+    {
+        return { sock.get_fd(), POLLOUT, timeout, std::move(token) };
+    }
+
+
+    wait_op
+    sleep_for(std::chrono::milliseconds timeout,
+              std::stop_token token)
+        noexcept
+    {
+        return { -1, 0, timeout, std::move(token) };
+    }
+
+
+    void
+    stop()
+    {
+        std::jthread old;
+        {
+            std::lock_guard lock{mutex};
+            if (!thread.joinable())
+                return;
+            stopping = true;
+            old = std::move(thread);
+        }
+        old.request_stop();
+        wake(); // in case it's in poll()
+        old.join();
+
+        std::lock_guard lock{mutex};
+        stopping = false;
+        wakeup = net::socket{};
+    }
+
+} // namespace reactor
@@ -0,0 +1,117 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <expected>
+#include <optional>
+#include <stop_token>
+
+#include "net/error.hpp"
+#include "net/socket.hpp"
+
+
+/*
+ * A single thread that waits on sockets and timers for coroutines.
+ *
+ * All registered sockets are polled together, with a single poll() call, so any number of
+ * waiting coroutines only use one of the OS's poll slots (see net/io_slots.hpp). Suspended
+ * coroutines are resumed from the reactor thread.
+ *
+ * The thread is started when the first coroutine waits. A loopback socket is polled along
+ * with the others, so new waits and cancellations wake it up right away.
+ */
+
+namespace reactor {
+
+    using clock = std::chrono::steady_clock;
+
+
+    // Note: the data members are managed by the reactor thread.
+    struct wait_op {
+
+        // Called when a stop is requested, to resume the coroutine early.
+        struct canceler {
+            wait_op* op;
+            void operator ()() const noexcept;
+        };
+
+        int fd;                 // -1 for a plain timer
+        short events;
+        clock::time_point deadline;
+        std::stop_token token;
+        std::coroutine_handle<> handle;
+        std::expected<short, net::error> revents = 0;
+        std::atomic<bool> canceled = false;
+        std::optional<std::stop_callback<canceler>> on_stop;
+
+
+        wait_op(int fd,
+                short events,
+                std::chrono::milliseconds timeout,
+                std::stop_token token)
+            noexcept;
+
+
+        bool
+        await_ready()
+            const noexcept
+        {
+            return false;
+        }
+
+
+        // Returns false, to not suspend, if the reactor is stopping, or a stop was already
+        // requested.
+        bool
+        await_suspend(std::coroutine_handle<> h);
+
+
+        // True if the socket is ready (or has an error to report), false on timeout.
+        std::expected<bool, net::error>
+        await_resume()
+            const noexcept;
+
+    };
+
+
+    // Note: when a stop is requested through the token, the waits below end within
+    // milliseconds, with an ECANCELED error. If the deadline comes while no poll slot is
+    // available, the socket waits end with EBUSY instead of a timeout.
+
+    // Wait until the socket can be read from, or the timeout expires.
+    wait_op readable(const net::socket& sock,
+                     std::chrono::milliseconds timeout,
+                     std::stop_token token = {})
+        noexcept;
+
+    // Wait until the socket can be written to, or the timeout expires.
+    wait_op writable(const net::socket& sock,
+                     std::chrono::milliseconds timeout,
+                     std::stop_token token = {})
+        noexcept;
+
+    // Wait until the timeout expires.
+    wait_op sleep_for(std::chrono::milliseconds timeout,
+                      std::stop_token token = {})
+        noexcept;
+
+
+    /*
+     * Stop the reactor thread. Coroutines that are still waiting are resumed with an
+     * error. It starts again if another coroutine waits.
+     */
+    void stop();
+
+} // namespace reactor
+
+#endif
@@ -0,0 +1,391 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>            // max(), min(), ranges::sort()
+#include <chrono>
+#include <cstdio>               // snprintf()
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <wupsxx/logger.hpp>
+#include <wupsxx/storage.hpp>
+
+#include "scorecard.hpp"
+
+#include "utc.hpp"
+#include "utils.hpp"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+
+using namespace std::literals;
+
+namespace logger = wups::logger;
+
+
+namespace scorecard {
+
+    namespace {
+
+        const char* storage_key = "scorecard";
+
+        // Weight of each new measurement in the moving averages.
+        constexpr double alpha = 0.25;
+
+        // How many queries are needed before trusting an entry.
+        constexpr unsigned min_queries = 3;
+
+        // Saturation point for the query counter.
+        constexpr unsigned max_queries = 15;
+
+        // Addresses that lose more than this are dropped.
+        constexpr double max_loss = 0.75;
+
+        // Addresses that lose less than this are considered reliable.
+        constexpr double reliable_loss = 0.25;
+
+        // When there are this many reliable addresses, the others are not queried. Four
+        // addresses are enough for a majority, even if one of them is a falseticker.
+        constexpr std::size_t top_k = 4;
+
+        // Pool addresses change often, don't remember them for too long.
+        constexpr dbl_seconds max_age = 7 * 24h;
+
+        // Keep the stored string small.
+        constexpr std::size_t max_entries = 32;
+
+        // Lower bound for the retransmission timeout, for addresses with a very stable RTT.
+        constexpr dbl_seconds min_rto = 250ms;
+
+        // Retransmission timeout for addresses with no RTT history.
+        constexpr std::chrono::milliseconds default_rto = 1000ms;
+
+        // Backoff after the first RATE Kiss-o'-Death; it doubles if the server keeps sending
+        // them.
+        constexpr dbl_seconds rate_backoff = 1h;
+
+        // Longest backoff, also used for DENY and RSTR.
+        constexpr dbl_seconds max_backoff = 24h;
+
+
+        std::mutex mutex;
+
+        bool loaded = false;
+        std::map<net::address, entry> entries;
+
+
+        // Note: all functions below assume the mutex is locked.
+
+
+        void
+        load()
+        {
+            if (loaded)
+                return;
+            loaded = true;
+
+            try {
+                auto str = wups::storage::load<std::string>(storage_key);
+                if (!str)
+                    return;
+                // Format: ip,port,rtt,rtt_var,loss,stratum,last_kod,backoff,kiss_code,last_seen,queries ...
+                for (auto& token : utils::split(*str, " ")) {
+                    auto fields = utils::split(token, ",");
+                    if (fields.size() != 11)
+                        continue;
+                    net::address addr{ static_cast<net::ipv4_t>(std::stoul(fields[0])),
+                                       static_cast<net::port_t>(std::stoul(fields[1])) };
+                    entries[addr] = {
+                        .rtt = dbl_seconds{std::stod(fields[2])},
+                        .rtt_var = dbl_seconds{std::stod(fields[3])},
+                        .loss = std::stod(fields[4]),
+                        .stratum = static_cast<unsigned>(std::stoul(fields[5])),
+                        .last_kod = std::stoll(fields[6]),
+                        .backoff = dbl_seconds{std::stod(fields[7])},
+                        .kiss_code = fields[8] == "-" ? ""s : fields[8],
+                        .last_seen = std::stoll(fields[9]),
+                        .queries = static_cast<unsigned>(std::stoul(fields[10])),
+                    };
+                }
+            }
+            catch (std::exception& e) {
+                logger::printf("Error loading scorecard: %s\n", e.what());
+                entries.clear();
+            }
+        }
+
+
+        // Forget old entries, then the least recently seen ones.
+        void
+        prune()
+        {
+            const std::int64_t now = utc::now().ticks;
+            std::erase_if(entries,
+                          [now](const auto& kv)
+                          {
+                              return utc::from_ticks(now - kv.second.last_seen) > max_age;
+                          });
+
+            while (entries.size() > max_entries) {
+                auto oldest = std::ranges::min_element(entries, {},
+                                                       [](const auto& kv)
+                                                       {
+                                                           return kv.second.last_seen;
+                                                       });
+                entries.erase(oldest);
+            }
+        }
+
+
+        entry&
+        update(net::address addr)
+        {
+            auto& e = entries[addr];
+            e.last_seen = utc::now().ticks;
+            if (e.queries < max_queries)
+                ++e.queries;
+            return e;
+        }
+
+
+        bool
+        is_bad(const entry& e)
+        {
+            return e.queries >= min_queries && e.loss > max_loss;
+        }
+
+
+        bool
+        is_reliable(const entry& e)
+        {
+            return e.queries >= min_queries && e.loss < reliable_loss;
+        }
+
+
+        dbl_seconds
+        remaining_backoff(const entry& e)
+        {
+            if (!e.last_kod)
+                return 0s;
+            dbl_seconds elapsed = utc::from_ticks(utc::now().ticks - e.last_kod);
+            // If the clock went backwards, don't wait forever.
+            if (elapsed < 0s)
+                return e.backoff;
+            return std::max(e.backoff - elapsed, dbl_seconds{0});
+        }
+
+
+        // Lower is better: the expected time to get a reply.
+        double
+        cost(const entry& e)
+        {
+            return e.rtt.count() / (1 - std::min(e.loss, 0.99));
+        }
+
+    } // namespace
+
+
+    void
+    record_reply(net::address addr,
+                 dbl_seconds rtt,
+                 unsigned stratum)
+    {
+        std::lock_guard guard{mutex};
+        load();
+        bool first = !entries.contains(addr);
+        auto& e = update(addr);
+        if (first || e.rtt == 0s) {
+            e.rtt = rtt;
+            e.rtt_var = rtt / 2;
+        } else {
+            // Same as RFC 6298, the variance is updated first.
+            e.rtt_var += alpha * (abs(rtt - e.rtt) - e.rtt_var);
+            e.rtt += alpha * (rtt - e.rtt);
+        }
+        e.loss -= alpha * e.loss;
+        e.stratum = stratum;
+    }
+
+
+    void
+    record_loss(net::address addr)
+    {
+        std::lock_guard guard{mutex};
+        load();
+        auto& e = update(addr);
+        e.loss += alpha * (1 - e.loss);
+    }
+
+
+    void
+    record_kod(net::address addr,
+               const std::string& code)
+    {
+        std::lock_guard guard{mutex};
+        load();
+        auto& e = update(addr);
+
+        if (code == "RATE") {
+            // Double the backoff if the previous one ended recently.
+            bool again = e.last_kod
+                && utc::from_ticks(e.last_seen - e.last_kod) < 2 * e.backoff;
+            e.backoff = again ? std::min(2 * e.backoff, max_backoff) : rate_backoff;
+        } else if (code == "DENY" || code == "RSTR")
+            e.backoff = max_backoff;
+        else
+            return; // other codes are informational
+
+        e.last_kod = e.last_seen;
+        e.kiss_code = code;
+    }
+
+
+    std::optional<entry>
+    find(net::address addr)
+    {
+        std::lock_guard guard{mutex};
+        load();
+        auto it = entries.find(addr);
+        if (it == entries.end())
+            return {};
+        return it->second;
+    }
+
+
+    std::chrono::milliseconds
+    retransmit_timeout(net::address addr)
+    {
+        std::lock_guard guard{mutex};
+        load();
+        auto it = entries.find(addr);
+        if (it == entries.end() || it->second.rtt == 0s)
+            return default_rto;
+        dbl_seconds rto = std::max(it->second.rtt + 4 * it->second.rtt_var, min_rto);
+        return std::chrono::ceil<std::chrono::milliseconds>(rto);
+    }
+
+
+    std::optional<dbl_seconds>
+    backoff_left(net::address addr)
+    {
+        std::lock_guard guard{mutex};
+        load();
+        auto it = entries.find(addr);
+        if (it == entries.end())
+            return {};
+        dbl_seconds left = remaining_backoff(it->second);
+        if (left <= 0s)
+            return {};
+        return left;
+    }
+
+
+    std::string
+    backoff_reason(net::address addr)
+    {
+        std::lock_guard guard{mutex};
+        load();
+        auto it = entries.find(addr);
+        if (it == entries.end())
+            return {};
+        return it->second.kiss_code + ", "
+            + time_utils::seconds_to_human(remaining_backoff(it->second)) + " left";
+    }
+
+
+    ranking
+    rank(const std::set<net::address>& addresses)
+    {
+        std::lock_guard guard{mutex};
+        load();
+
+        ranking result;
+
+        std::vector<std::pair<net::address, const entry*>> reliable;
+        std::vector<net::address> unknown;
+        std::vector<net::address> bad;
+        for (auto addr : addresses) {
+            auto it = entries.find(addr);
+            if (it != entries.end() && remaining_backoff(it->second) > 0s)
+                result.backed_off.push_back(addr);
+            else if (it == entries.end() || !(is_reliable(it->second) || is_bad(it->second)))
+                unknown.push_back(addr);
+            else if (is_bad(it->second))
+                bad.push_back(addr);
+            else
+                reliable.emplace_back(addr, &it->second);
+        }
+
+        std::ranges::sort(reliable, {}, [](const auto& p) { return cost(*p.second); });
+
+        for (auto& [addr, e] : reliable)
+            result.chosen.push_back(addr);
+
+        // Enough reliable addresses, the others are not needed.
+        if (result.chosen.size() >= top_k) {
+            result.spares.assign(result.chosen.begin() + top_k, result.chosen.end());
+            result.spares.insert(result.spares.end(), unknown.begin(), unknown.end());
+            result.chosen.resize(top_k);
+            result.fallbacks = std::move(bad);
+            return result;
+        }
+
+        result.chosen.insert(result.chosen.end(), unknown.begin(), unknown.end());
+
+        // Only use bad addresses as a last resort.
+        if (result.chosen.empty())
+            result.chosen = std::move(bad);
+        else
+            result.fallbacks = std::move(bad);
+
+        return result;
+    }
+
+
+    void
+    save()
+    {
+        std::string str;
+        {
+            std::lock_guard guard{mutex};
+            if (!loaded)
+                return;
+            prune();
+            for (auto& [addr, e] : entries) {
+                char buf[160];
+                std::snprintf(buf, sizeof buf, "%s%u,%u,%.6g,%.6g,%.3g,%u,%lld,%.6g,%s,%lld,%u",
+                              str.empty() ? "" : " ",
+                              static_cast<unsigned>(addr.ip),
+                              static_cast<unsigned>(addr.port),
+                              e.rtt.count(),
+                              e.rtt_var.count(),
+                              e.loss,
+                              e.stratum,
+                              static_cast<long long>(e.last_kod),
+                              e.backoff.count(),
+                              e.kiss_code.empty() ? "-" : e.kiss_code.c_str(),
+                              static_cast<long long>(e.last_seen),
+                              e.queries);
+                str += buf;
+            }
+        }
+
+        logger::guard guard(PACKAGE_NAME);
+        try {
+            wups::storage::store(storage_key, str);
+            wups::storage::save();
+        }
+        catch (std::exception& e) {
+            logger::printf("Error storing scorecard: %s\n", e.what());
+        }
+    }
+
+} // namespace scorecard
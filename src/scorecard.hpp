@@ -0,0 +1,92 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SCORECARD_HPP
+#define SCORECARD_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "net/address.hpp"
+#include "time_utils.hpp"
+
+
+/*
+ * History of each NTP server address.
+ *
+ * This is used to query the fastest and most reliable addresses first, and to skip
+ * addresses that keep failing. It's kept in storage, so it's available on boot.
+ */
+
+namespace scorecard {
+
+    using time_utils::dbl_seconds;
+
+
+    struct entry {
+        dbl_seconds   rtt{0};       // moving average of the round-trip time
+        dbl_seconds   rtt_var{0};   // moving average of the round-trip time's deviation
+        double        loss = 0;     // moving average of the loss rate, from 0 to 1
+        unsigned      stratum = 0;  // last stratum reported
+        std::int64_t  last_kod = 0; // UTC ticks of the last Kiss-o'-Death, 0 if none
+        dbl_seconds   backoff{0};   // how long after last_kod the address must not be queried
+        std::string   kiss_code;    // code from the last Kiss-o'-Death
+        std::int64_t  last_seen = 0;// UTC ticks of the last update
+        unsigned      queries = 0;  // how many updates were made, saturates at a small number
+    };
+
+
+    void record_reply(net::address addr, dbl_seconds rtt, unsigned stratum);
+
+    void record_loss(net::address addr);
+
+    // Record a Kiss-o'-Death; the codes RATE, DENY and RSTR make the address be skipped.
+    void record_kod(net::address addr, const std::string& code);
+
+
+    std::optional<entry> find(net::address addr);
+
+
+    // How long to wait for a reply before sending the request again, like TCP does.
+    std::chrono::milliseconds retransmit_timeout(net::address addr);
+
+
+    struct ranking {
+        std::vector<net::address> chosen;     // addresses to query, best first
+        std::vector<net::address> spares;     // good addresses that were not needed, best first
+        std::vector<net::address> fallbacks;  // addresses that keep failing, if not chosen
+        std::vector<net::address> backed_off; // addresses that asked us to stop for a while
+    };
+
+
+    // How long until the address can be queried again, after a Kiss-o'-Death.
+    std::optional<dbl_seconds> backoff_left(net::address addr);
+
+
+    // Describe why the address is being skipped, like "RATE, 42.0 min left".
+    std::string backoff_reason(net::address addr);
+
+
+    /*
+     * Sort addresses from best to worst, and set aside addresses that keep failing. If there
+     * are enough reliable addresses, only the best ones are chosen, the others are spares.
+     * The failing addresses are only chosen if there's nothing else.
+     */
+    ranking rank(const std::set<net::address>& addresses);
+
+
+    // Write the scorecard to storage.
+    void save();
+
+} // namespace scorecard
+
+#endif
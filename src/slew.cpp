@@ -0,0 +1,135 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>            // max()
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#include <wupsxx/logger.hpp>
+
+#include "slew.hpp"
+
+#include "core.hpp"
+#include "executor.hpp"
+#include "utc.hpp"
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+
+using namespace std::literals;
+
+namespace logger = wups::logger;
+
+
+namespace slew {
+
+    namespace {
+
+        // Time between steps.
+        constexpr auto step_interval = 1s;
+
+
+        // Progress of the current slew.
+        std::mutex mutex;
+        std::int64_t total_ticks = 0;
+        std::int64_t applied_ticks = 0;
+        std::int64_t start_ticks = 0;
+        std::int64_t window_ticks = 1;
+
+        // Incremented when a slew is started or canceled, so old steps do nothing.
+        unsigned generation = 0;
+        timer_handle timer;
+
+
+        void step(unsigned gen);
+
+
+        // Assumes the mutex is locked.
+        void
+        schedule_step(unsigned gen)
+        {
+            timer = executor::submit_after(step_interval, [gen] { step(gen); });
+        }
+
+
+        void
+        step(unsigned gen)
+        {
+            logger::guard logger_guard{PACKAGE_NAME};
+
+            std::lock_guard lock{mutex};
+            if (gen != generation)
+                return; // canceled
+
+            std::int64_t elapsed = utc::monotonic_ticks() - start_ticks;
+            std::int64_t target = total_ticks;
+            if (elapsed < window_ticks)
+                target = static_cast<std::int64_t>(static_cast<double>(total_ticks)
+                                                   * elapsed / window_ticks);
+
+            std::int64_t delta = target - applied_ticks;
+            if (delta) {
+                if (!core::apply_clock_correction(utc::from_ticks(delta))) {
+                    logger::printf("Failed to slew the clock, %s left.\n",
+                                   time_utils::seconds_to_human(utc::from_ticks(total_ticks
+                                                                                - applied_ticks),
+                                                                true).c_str());
+                    return;
+                }
+                applied_ticks = target;
+            }
+
+            if (applied_ticks != total_ticks)
+                schedule_step(gen);
+        }
+
+
+        // Assumes the mutex is locked.
+        dbl_seconds
+        stop_steps()
+        {
+            ++generation;
+            timer.cancel();
+            dbl_seconds left = utc::from_ticks(total_ticks - applied_ticks);
+            total_ticks = applied_ticks = 0;
+            return left;
+        }
+
+    } // namespace
+
+
+    dbl_seconds
+    start(dbl_seconds correction,
+          dbl_seconds window)
+    {
+        std::lock_guard guard{mutex};
+        dbl_seconds left = stop_steps();
+
+        total_ticks = utc::to_ticks(std::chrono::duration_cast<ntp::fixed_seconds>(correction));
+        applied_ticks = 0;
+        start_ticks = utc::monotonic_ticks();
+        window_ticks = utc::to_ticks(std::chrono::duration_cast<ntp::fixed_seconds>(window));
+        window_ticks = std::max<std::int64_t>(window_ticks, 1);
+        if (total_ticks)
+            schedule_step(generation);
+
+        return left;
+    }
+
+
+    dbl_seconds
+    cancel()
+    {
+        std::lock_guard guard{mutex};
+        return stop_steps();
+    }
+
+} // namespace slew
@@ -0,0 +1,39 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SLEW_HPP
+#define SLEW_HPP
+
+#include "time_utils.hpp"
+
+
+/*
+ * Gradual clock correction.
+ *
+ * Instead of stepping the clock at once, the correction is split into small steps, one
+ * every second, spread over a time window. Progress is measured with the monotonic clock,
+ * so the steps themselves don't affect the schedule. Each step is a timer on the executor,
+ * so no thread is blocked between steps.
+ */
+
+namespace slew {
+
+    using time_utils::dbl_seconds;
+
+
+    // Start slewing the clock; replaces the slew in progress, returning how much of it
+    // was not applied.
+    dbl_seconds start(dbl_seconds correction, dbl_seconds window);
+
+
+    // Cancel the slew in progress, returning how much of it was not applied.
+    dbl_seconds cancel();
+
+} // namespace slew
+
+#endif
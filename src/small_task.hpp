@@ -0,0 +1,214 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef SMALL_TASK_HPP
+#define SMALL_TASK_HPP
+
+#include <cstddef>              // max_align_t, size_t
+#include <new>                  // launder()
+#include <type_traits>          // decay_t<>, is_nothrow_move_constructible_v<>, is_same_v<>
+#include <utility>              // exchange(), forward(), move()
+
+
+/*
+ * A move-only void() callable, like std::move_only_function<void()>, but callables that
+ * fit in the inline buffer are stored without allocating memory.
+ *
+ * Larger callables, or callables that could throw while moving, are stored in the heap.
+ */
+class small_task {
+
+    // Enough for the thread_pool's wrapper around a function pointer and two std::string
+    // arguments, on the Wii U.
+    static constexpr std::size_t inline_size = 64;
+
+
+    struct ops_t {
+        void (*invoke)(void* storage);
+        // Move-construct into dst, and destroy the source.
+        void (*relocate)(void* dst, void* src) noexcept;
+        void (*destroy)(void* storage) noexcept;
+    };
+
+
+    template<typename F>
+    static constexpr bool is_inline = sizeof(F) <= inline_size
+        && alignof(F) <= alignof(std::max_align_t)
+        && std::is_nothrow_move_constructible_v<F>;
+
+
+    // The callable lives in the storage.
+    template<typename F>
+    struct inline_ops {
+
+        static
+        F*
+        get(void* storage)
+            noexcept
+        {
+            return std::launder(static_cast<F*>(storage));
+        }
+
+
+        static
+        void
+        invoke(void* storage)
+        {
+            (*get(storage))();
+        }
+
+
+        static
+        void
+        relocate(void* dst,
+                 void* src)
+            noexcept
+        {
+            ::new (dst) F(std::move(*get(src)));
+            get(src)->~F();
+        }
+
+
+        static
+        void
+        destroy(void* storage)
+            noexcept
+        {
+            get(storage)->~F();
+        }
+
+
+        static constexpr ops_t table{ invoke, relocate, destroy };
+
+    };
+
+
+    // The storage only holds a pointer to the callable.
+    template<typename F>
+    struct heap_ops {
+
+        static
+        F*&
+        get(void* storage)
+            noexcept
+        {
+            return *std::launder(static_cast<F**>(storage));
+        }
+
+
+        static
+        void
+        invoke(void* storage)
+        {
+            (*get(storage))();
+        }
+
+
+        static
+        void
+        relocate(void* dst,
+                 void* src)
+            noexcept
+        {
+            ::new (dst) F*(get(src));
+        }
+
+
+        static
+        void
+        destroy(void* storage)
+            noexcept
+        {
+            delete get(storage);
+        }
+
+
+        static constexpr ops_t table{ invoke, relocate, destroy };
+
+    };
+
+
+    alignas(std::max_align_t) unsigned char storage[inline_size];
+    const ops_t* ops = nullptr;
+
+public:
+
+    small_task()
+        noexcept = default;
+
+
+    template<typename Func>
+        requires (!std::is_same_v<std::decay_t<Func>, small_task>)
+    small_task(Func&& func)
+    {
+        using F = std::decay_t<Func>;
+        if constexpr (is_inline<F>) {
+            ::new (storage) F(std::forward<Func>(func));
+            ops = &inline_ops<F>::table;
+        } else {
+            ::new (storage) F*(new F(std::forward<Func>(func)));
+            ops = &heap_ops<F>::table;
+        }
+    }
+
+
+    small_task(small_task&& other)
+        noexcept :
+        ops{std::exchange(other.ops, nullptr)}
+    {
+        if (ops)
+            ops->relocate(storage, other.storage);
+    }
+
+
+    small_task&
+    operator =(small_task&& other)
+        noexcept
+    {
+        if (this != &other) {
+            reset();
+            ops = std::exchange(other.ops, nullptr);
+            if (ops)
+                ops->relocate(storage, other.storage);
+        }
+        return *this;
+    }
+
+
+    ~small_task()
+    {
+        reset();
+    }
+
+
+    void
+    reset()
+        noexcept
+    {
+        if (ops)
+            std::exchange(ops, nullptr)->destroy(storage);
+    }
+
+
+    explicit
+    operator bool()
+        const noexcept
+    {
+        return ops;
+    }
+
+
+    void
+    operator ()()
+    {
+        ops->invoke(storage);
+    }
+
+};
+
+#endif
@@ -16,6 +16,7 @@
 
 #include "cfg.hpp"
 #include "core.hpp"
+#include "executor.hpp"
 
 
 using namespace std::literals;
@@ -56,9 +57,8 @@ synchronize_item::on_started()
         }
     };
 
-    task_result = std::async(std::launch::async,
-                             std::move(task),
-                             task_stopper.get_token());
+    task_result = executor::get().submit(std::move(task),
+                                         task_stopper.get_token());
 }
 
 
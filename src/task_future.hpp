@@ -0,0 +1,388 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef TASK_FUTURE_HPP
+#define TASK_FUTURE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>              // size_t
+#include <exception>            // exception_ptr, rethrow_exception()
+#include <functional>           // invoke()
+#include <future>               // future_error, future_errc, future_status
+#include <mutex>
+#include <optional>
+#include <type_traits>          // conditional_t<>, is_void_v<>
+#include <utility>              // exchange(), forward(), move()
+
+#include "small_task.hpp"
+
+
+/*
+ * A lighter std::promise/std::future pair.
+ *
+ * The shared states are recycled, so after the first few tasks, creating a promise doesn't
+ * allocate memory. A future can also be given a continuation, to be called as soon as the
+ * result is ready, instead of having a thread wait for it.
+ */
+
+template<typename T>
+class task_promise;
+
+
+namespace detail {
+
+    struct empty_value {};
+
+
+    template<typename T>
+    struct future_state {
+
+        using value_type = std::conditional_t<std::is_void_v<T>, empty_value, T>;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::atomic<bool> ready = false;
+        std::optional<value_type> value;
+        std::exception_ptr error;
+
+        // Set by task_future::then(), called by the thread that sets the result.
+        small_task continuation;
+
+        // One for the promise, one for the future.
+        std::atomic<unsigned> refs = 0;
+
+        future_state* next_free = nullptr;
+
+    };
+
+
+    template<typename T>
+    class state_pool {
+
+        // Don't hold on to more memory than the plugin normally needs.
+        static constexpr std::size_t max_free = 16;
+
+        std::mutex mutex;
+        future_state<T>* free_list = nullptr;
+        std::size_t num_free = 0;
+
+    public:
+
+        static
+        state_pool&
+        instance()
+        {
+            static state_pool pool;
+            return pool;
+        }
+
+
+        ~state_pool()
+        {
+            while (free_list)
+                delete std::exchange(free_list, free_list->next_free);
+        }
+
+
+        future_state<T>*
+        acquire()
+        {
+            future_state<T>* state = nullptr;
+            {
+                std::lock_guard guard{mutex};
+                if (free_list) {
+                    state = std::exchange(free_list, free_list->next_free);
+                    --num_free;
+                }
+            }
+            if (!state)
+                state = new future_state<T>;
+            state->refs = 1;
+            return state;
+        }
+
+
+        void
+        release(future_state<T>* state)
+            noexcept
+        {
+            if (state->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+
+            state->ready = false;
+            state->value.reset();
+            state->error = nullptr;
+            state->continuation.reset();
+
+            {
+                std::lock_guard guard{mutex};
+                if (num_free < max_free) {
+                    state->next_free = std::exchange(free_list, state);
+                    ++num_free;
+                    return;
+                }
+            }
+            delete state;
+        }
+
+    };
+
+} // namespace detail
+
+
+template<typename T>
+class task_future {
+
+    using state_type = detail::future_state<T>;
+
+    state_type* state = nullptr;
+
+    friend class task_promise<T>;
+
+
+    explicit
+    task_future(state_type* state)
+        noexcept :
+        state{state}
+    {}
+
+
+    void
+    check_state()
+        const
+    {
+        if (!state)
+            throw std::future_error{std::future_errc::no_state};
+    }
+
+public:
+
+    task_future()
+        noexcept = default;
+
+
+    task_future(task_future&& other)
+        noexcept :
+        state{std::exchange(other.state, nullptr)}
+    {}
+
+
+    task_future&
+    operator =(task_future&& other)
+        noexcept
+    {
+        if (this != &other) {
+            if (state)
+                detail::state_pool<T>::instance().release(state);
+            state = std::exchange(other.state, nullptr);
+        }
+        return *this;
+    }
+
+
+    ~task_future()
+    {
+        if (state)
+            detail::state_pool<T>::instance().release(state);
+    }
+
+
+    bool
+    valid()
+        const noexcept
+    {
+        return state;
+    }
+
+
+    void
+    wait()
+        const
+    {
+        check_state();
+        if (state->ready.load(std::memory_order_acquire))
+            return;
+        std::unique_lock guard{state->mutex};
+        state->cond.wait(guard, [this] { return state->ready.load(); });
+    }
+
+
+    template<typename Rep,
+             typename Period>
+    std::future_status
+    wait_for(const std::chrono::duration<Rep, Period>& timeout)
+        const
+    {
+        check_state();
+        if (state->ready.load(std::memory_order_acquire))
+            return std::future_status::ready;
+        std::unique_lock guard{state->mutex};
+        if (state->cond.wait_for(guard, timeout, [this] { return state->ready.load(); }))
+            return std::future_status::ready;
+        return std::future_status::timeout;
+    }
+
+
+    // Like std::future::get(), this leaves the future without a state.
+    T
+    get()
+    {
+        wait();
+        // The state is released when this returns.
+        task_future done{std::exchange(state, nullptr)};
+        if (done.state->error)
+            std::rethrow_exception(done.state->error);
+        if constexpr (!std::is_void_v<T>)
+            return std::move(*done.state->value);
+    }
+
+
+    /*
+     * Call func(std::move(*this)) once the result is ready; this future is left without a
+     * state.
+     *
+     * If the result is already available, func is called right away; otherwise it's called
+     * from the thread that sets the result, so it should be short, and not throw.
+     */
+    template<typename Func>
+    void
+    then(Func&& func)
+        &&
+    {
+        check_state();
+        state_type* s = state;
+        small_task continuation{[future = std::move(*this),
+                                 func = std::forward<Func>(func)]() mutable
+                                {
+                                    std::invoke(func, std::move(future));
+                                }};
+        {
+            std::lock_guard guard{s->mutex};
+            if (!s->ready) {
+                s->continuation = std::move(continuation);
+                return;
+            }
+        }
+        continuation();
+    }
+
+};
+
+
+template<typename T>
+class task_promise {
+
+    using state_type = detail::future_state<T>;
+
+    state_type* state;
+
+
+    void
+    finish()
+    {
+        small_task continuation;
+        {
+            std::lock_guard guard{state->mutex};
+            state->ready = true;
+            continuation = std::move(state->continuation);
+        }
+        state->cond.notify_all();
+        if (continuation) {
+            try {
+                continuation();
+            }
+            catch (...) {
+                // Note: the result was already delivered, there's nobody left to report to.
+            }
+        }
+    }
+
+
+    void
+    check_unsatisfied()
+        const
+    {
+        if (!state)
+            throw std::future_error{std::future_errc::no_state};
+        if (state->ready)
+            throw std::future_error{std::future_errc::promise_already_satisfied};
+    }
+
+public:
+
+    task_promise() :
+        state{detail::state_pool<T>::instance().acquire()}
+    {}
+
+
+    task_promise(task_promise&& other)
+        noexcept :
+        state{std::exchange(other.state, nullptr)}
+    {}
+
+
+    task_promise&
+    operator =(task_promise&& other)
+        noexcept
+    {
+        if (this != &other) {
+            task_promise old{std::move(*this)};
+            state = std::exchange(other.state, nullptr);
+        }
+        return *this;
+    }
+
+
+    // Like std::promise, a promise destroyed without a result breaks it.
+    ~task_promise()
+    {
+        if (!state)
+            return;
+        if (!state->ready) {
+            state->error = std::make_exception_ptr(
+                               std::future_error{std::future_errc::broken_promise});
+            finish();
+        }
+        detail::state_pool<T>::instance().release(state);
+    }
+
+
+    // Note: unlike std::promise, this can be called more than once.
+    task_future<T>
+    get_future()
+    {
+        if (!state)
+            throw std::future_error{std::future_errc::no_state};
+        ++state->refs;
+        return task_future<T>{state};
+    }
+
+
+    template<typename... Args>
+    void
+    set_value(Args&&... args)
+    {
+        check_unsatisfied();
+        state->value.emplace(std::forward<Args>(args)...);
+        finish();
+    }
+
+
+    void
+    set_exception(std::exception_ptr error)
+    {
+        check_unsatisfied();
+        state->error = std::move(error);
+        finish();
+    }
+
+};
+
+#endif
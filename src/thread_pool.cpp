@@ -15,20 +15,22 @@ thread_pool::worker_thread(std::stop_token token)
     try {
         while (!token.stop_requested()) {
             auto task = tasks.pop();
+            --num_queued_tasks;
             --num_idle_workers;
             task();
             ++num_idle_workers;
         }
     }
-    catch (async_queue<task_type>::stop_request& r) {}
+    catch (queue_type::stop_request& r) {}
 }
 
 
 void
 thread_pool::add_worker()
 {
-    // Obey the limit.
-    if (workers.size() >= max_workers)
+    std::lock_guard guard{workers_mutex};
+    // Obey the limit, and don't start workers that would stop right away.
+    if (workers.size() >= max_workers || tasks.is_stopping())
         return;
     ++num_idle_workers;
     workers.emplace_back([this](std::stop_token token) { worker_thread(token); });
@@ -40,12 +42,43 @@ thread_pool::thread_pool(unsigned max_workers) :
 {}
 
 
-thread_pool::~thread_pool()
+void
+thread_pool::stop_workers()
+{
+    std::vector<std::jthread> stopping;
+    {
+        std::lock_guard guard{workers_mutex};
+        // This will wake up all threads stuck waiting for more tasks, they will all throw
+        // tasks_queue::stop_request{}.
+        tasks.stop();
+        stopping = std::move(workers);
+        workers.clear();
+    }
+
+    // Note: join without holding the lock; a task still running may submit more work, and
+    // add_worker() needs the lock. Destroying the jthreads will join them.
+    stopping.clear();
+
+    // Nobody will pick up the queued tasks; destroying them breaks their promises, so
+    // whoever waits on them gets an error instead of waiting forever. Their continuations
+    // may submit more work, so this is also done without the lock.
+    tasks.clear();
+    num_queued_tasks = 0;
+    num_idle_workers = 0;
+}
+
+
+void
+thread_pool::release_workers()
 {
-    // This will wake up all threads stuck waiting for more tasks, they will all throw
-    // tasks_queue::stop_request{}.
-    tasks.stop();
+    stop_workers();
+    tasks.reset();
+}
 
-    // The jthread destructor will also notify the stop token, so we don't need to do
-    // anything else.
+
+thread_pool::~thread_pool()
+{
+    // Join the workers now, while the queue and counters they use still exist; a worker
+    // running a task finishes it first.
+    stop_workers();
 }
@@ -10,35 +10,49 @@
 #define THREAD_POOL_HPP
 
 #include <atomic>
-#include <exception>
-#include <functional>           // bind(), move_only_function<>
-#include <future>
+#include <cstddef>              // size_t
+#include <exception>            // current_exception()
+#include <functional>           // invoke()
 #include <mutex>
 #include <thread>
-#include <type_traits>          // decay_t<>, invoke_result_t<>
+#include <type_traits>          // decay_t<>, invoke_result_t<>, is_void_v<>
 #include <utility>              // forward(), move()
 #include <vector>
 
 #include "async_queue.hpp"
+#include "mpmc_ring.hpp"
+#include "small_task.hpp"
+#include "task_future.hpp"
 
 
 class thread_pool {
 
     unsigned max_workers;
 
+    // Note: the pool can be shared, so workers may be added from any thread.
+    std::mutex workers_mutex;
     std::vector<std::jthread> workers;
 
-    // Note: we can't use std::function because we're putting std::packaged_task in there,
-    // and std::packaged_task is only movable, but std::function always tries to copy.
-    using task_type = std::move_only_function<void()>;
-    async_queue<task_type> tasks;
+    // Note: submitting a task should not allocate memory, so the tasks are stored inline,
+    // in a fixed-size queue. When it's full, submit() runs the task itself, instead of
+    // waiting for the workers. The lock-free ring hands a task to an idle worker faster than
+    // a mutex queue (bench/async_queue_bench.cpp); the pool never saturates it.
+    static constexpr std::size_t queue_capacity = 32;
+    using task_type = small_task;
+    using queue_type = async_queue<task_type, mpmc_ring<task_type, queue_capacity>>;
+    queue_type tasks;
 
     std::atomic_int num_idle_workers = 0;
+    // Tasks submitted, but not picked up by a worker yet.
+    std::atomic_int num_queued_tasks = 0;
 
     void worker_thread(std::stop_token token);
 
     void add_worker();
 
+    // Stop and join all workers, and discard the tasks they didn't pick up.
+    void stop_workers();
+
 public:
 
     thread_pool(unsigned max_workers);
@@ -46,28 +60,63 @@ public:
     ~thread_pool();
 
 
-    // This method behaves like std::async().
+    // Stop and join all workers, after they finish their current task. Queued tasks are
+    // discarded. New workers will be created when more tasks are submitted.
+    void release_workers();
+
+
+    /*
+     * This method behaves like std::async(). It never waits for the workers: if the queue is
+     * full, or there are no workers, the task runs on the calling thread. After a stop (from
+     * release_workers() or the destructor), the task is discarded, and the future reports
+     * std::future_errc::broken_promise, like tasks discarded from the queue.
+     */
     template<typename Func, typename... Args>
-    std::future<std::invoke_result_t<std::decay_t<Func>,
-                                     std::decay_t<Args>...>>
+    task_future<std::invoke_result_t<std::decay_t<Func>&,
+                                     std::decay_t<Args>&...>>
     submit(Func&& func, Args&&... args)
     {
-        using Ret = std::invoke_result_t<std::decay_t<Func>, std::decay_t<Args>...>;
-
-        auto bfunc = std::bind(std::forward<Func>(func),
-                               std::forward<Args>(args)...);
-
-        std::packaged_task<Ret()> task{std::move(bfunc)};
-        auto future = task.get_future();
-
-        if (max_workers == 0)
+        using Ret = std::invoke_result_t<std::decay_t<Func>&, std::decay_t<Args>&...>;
+
+        task_promise<Ret> promise;
+        auto future = promise.get_future();
+
+        small_task task{[promise = std::move(promise),
+                         func = std::forward<Func>(func),
+                         ...args = std::forward<Args>(args)]() mutable
+                        {
+                            try {
+                                if constexpr (std::is_void_v<Ret>) {
+                                    std::invoke(func, args...);
+                                    promise.set_value();
+                                } else
+                                    promise.set_value(std::invoke(func, args...));
+                            }
+                            catch (...) {
+                                promise.set_exception(std::current_exception());
+                            }
+                        }};
+
+        if (max_workers == 0) {
             task(); // If no worker will handle this, execute it immediately.
-        else {
-            // If all threads are busy, try to add another to the pool.
-            if (num_idle_workers == 0)
-                add_worker();
+            return future;
+        }
 
-            tasks.push(std::move(task));
+        // Note: the task is destroyed without running, which breaks the promise.
+        if (tasks.is_stopping())
+            return future;
+
+        // If there are not enough idle threads for the queued tasks, try to add another to
+        // the pool. Note: a new worker counts as idle before it gets to run, so comparing
+        // only against zero would queue a burst of tasks on a single worker.
+        if (++num_queued_tasks > num_idle_workers)
+            add_worker();
+
+        if (!tasks.try_push(std::move(task))) {
+            // The queue is full; doing the work here is better than blocking the caller,
+            // which may be the timer thread, or a worker.
+            --num_queued_tasks;
+            task();
         }
 
         return future;
@@ -0,0 +1,248 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <algorithm>            // min()
+#include <bit>                  // countr_zero(), rotr()
+#include <cmath>                // ceil(), floor()
+#include <utility>              // exchange(), move()
+
+#include "timer_wheel.hpp"
+
+
+std::uint64_t
+timer_wheel::to_tick(clock::time_point t,
+                     bool round_up)
+    const noexcept
+{
+    if (t <= epoch)
+        return 0;
+    auto ticks = std::chrono::duration<double>(t - epoch) / resolution;
+    return static_cast<std::uint64_t>(round_up ? std::ceil(ticks) : std::floor(ticks));
+}
+
+
+timer_wheel::clock::time_point
+timer_wheel::to_time(std::uint64_t tick)
+    const noexcept
+{
+    return epoch + tick * resolution;
+}
+
+
+void
+timer_wheel::link(node* n)
+    noexcept
+{
+    if (n->expire < next_tick)
+        n->expire = next_tick;
+
+    // Pick the lowest level that can hold this timer.
+    std::uint64_t delta = n->expire - next_tick;
+    unsigned level = 0;
+    while (level + 1 < num_levels && delta >= (std::uint64_t{1} << (level_bits * (level + 1))))
+        ++level;
+
+    std::uint64_t when = n->expire;
+    // Too far in the future: park it in the last slot that can be reached, it will be
+    // cascaded there, and land in a better slot.
+    const std::uint64_t max_delta = (std::uint64_t{1} << (level_bits * num_levels)) - 1;
+    if (delta > max_delta)
+        when = next_tick + max_delta;
+
+    n->level = level;
+    n->slot = (when >> (level_bits * level)) & (num_slots - 1);
+
+    node*& head = slots[level][n->slot];
+    n->prev = nullptr;
+    n->next = head;
+    if (head)
+        head->prev = n;
+    head = n;
+    occupied[level] |= std::uint64_t{1} << n->slot;
+}
+
+
+void
+timer_wheel::unlink(node* n)
+    noexcept
+{
+    node*& head = slots[n->level][n->slot];
+    if (n->prev)
+        n->prev->next = n->next;
+    else
+        head = n->next;
+    if (n->next)
+        n->next->prev = n->prev;
+    if (!head)
+        occupied[n->level] &= ~(std::uint64_t{1} << n->slot);
+    n->prev = n->next = nullptr;
+}
+
+
+/*
+ * The next tick where something happens: either timers in level 0 expire, or a slot in an
+ * upper level has to be cascaded.
+ */
+std::optional<std::uint64_t>
+timer_wheel::next_event()
+    const noexcept
+{
+    std::optional<std::uint64_t> result;
+    for (unsigned level = 0; level < num_levels; ++level) {
+        if (!occupied[level])
+            continue;
+        const unsigned shift = level_bits * level;
+        const std::uint64_t unit = std::uint64_t{1} << shift;
+        // First slot boundary of this level, at or after next_tick.
+        std::uint64_t base = (next_tick + unit - 1) >> shift;
+        unsigned offset = base & (num_slots - 1);
+        unsigned distance = std::countr_zero(std::rotr(occupied[level], offset));
+        std::uint64_t tick = (base + distance) << shift;
+        result = result ? std::min(*result, tick) : tick;
+    }
+    return result;
+}
+
+
+void
+timer_wheel::advance(std::uint64_t now,
+                     std::vector<std::shared_ptr<node>>& due)
+{
+    for (auto t = next_event(); t && *t <= now; t = next_event()) {
+        next_tick = *t;
+
+        // Move timers down, from the upper levels.
+        for (unsigned level = num_levels - 1; level > 0; --level) {
+            const unsigned shift = level_bits * level;
+            if (next_tick & ((std::uint64_t{1} << shift) - 1))
+                continue;
+            unsigned slot = (next_tick >> shift) & (num_slots - 1);
+            node* n = slots[level][slot];
+            while (n) {
+                node* next = n->next;
+                unlink(n);
+                link(n);
+                n = next;
+            }
+        }
+
+        unsigned slot = next_tick & (num_slots - 1);
+        while (node* n = slots[0][slot]) {
+            unlink(n);
+            due.push_back(std::move(n->self));
+        }
+
+        next_tick = *t + 1;
+    }
+
+    // Nothing happens until now, so the empty ticks can be skipped.
+    if (next_tick <= now)
+        next_tick = now + 1;
+}
+
+
+void
+timer_wheel::loop(std::stop_token token)
+{
+    std::vector<std::shared_ptr<node>> due;
+    std::unique_lock lock{mutex};
+    while (!token.stop_requested()) {
+        advance(to_tick(clock::now(), false), due);
+        if (!due.empty()) {
+            counters.fired += due.size();
+            lock.unlock();
+            for (auto& n : due)
+                n->callback();
+            due.clear();
+            lock.lock();
+            continue;
+        }
+
+        auto rescheduled = [this] { return std::exchange(changed, false); };
+        if (auto t = next_event())
+            cond.wait_until(lock, token, to_time(*t), rescheduled);
+        else
+            cond.wait(lock, token, rescheduled);
+        ++counters.wakeups;
+    }
+}
+
+
+bool
+timer_wheel::handle::cancel()
+{
+    auto n = timer.lock();
+    if (!wheel || !n)
+        return false;
+    std::lock_guard lock{wheel->mutex};
+    if (!n->self)
+        return false; // already fired
+    wheel->unlink(n.get());
+    n->self.reset();
+    ++wheel->counters.canceled;
+    return true;
+}
+
+
+timer_wheel::~timer_wheel()
+{
+    stop();
+    // Break the self references.
+    for (auto& level : slots)
+        for (node* head : level)
+            while (head)
+                std::exchange(head, head->next)->self.reset();
+}
+
+
+timer_wheel::handle
+timer_wheel::schedule_at(clock::time_point when,
+                         small_task callback)
+{
+    auto n = std::make_shared<node>();
+    // Round up, so timers don't fire early.
+    n->expire = to_tick(when, true);
+    n->callback = std::move(callback);
+    n->self = n;
+
+    handle result;
+    result.wheel = this;
+    result.timer = n;
+
+    std::lock_guard lock{mutex};
+    link(n.get());
+    if (!thread.joinable())
+        thread = std::jthread{[this](std::stop_token token) { loop(token); }};
+    // The thread may need to wake up sooner.
+    changed = true;
+    cond.notify_one();
+    return result;
+}
+
+
+void
+timer_wheel::stop()
+{
+    std::jthread old;
+    {
+        std::lock_guard lock{mutex};
+        old = std::move(thread);
+    }
+    if (old.joinable()) {
+        old.request_stop();
+        old.join();
+    }
+}
+
+
+timer_wheel::stats
+timer_wheel::get_stats()
+{
+    std::lock_guard lock{mutex};
+    return counters;
+}
@@ -0,0 +1,150 @@
+/*
+ * Time Sync - A NTP client plugin for the Wii U.
+ *
+ * Copyright (C) 2024  Daniel K. O.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>               // shared_ptr<>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include "small_task.hpp"
+
+
+/*
+ * Hierarchical timer wheel, with a single thread to fire the timers.
+ *
+ * Level 0 has one slot per tick; each level above has slots 64 times wider, so 4 levels
+ * cover about 46 hours. Timers in the upper levels are moved down ("cascaded") when their
+ * slot comes up. The thread only wakes up when a slot with timers comes up, not on every
+ * tick, so pending timers don't cost wakeups.
+ *
+ * Callbacks run in the timer thread, so they should be short; the executor uses it to
+ * submit tasks to the thread pool.
+ */
+class timer_wheel {
+
+public:
+
+    using clock = std::chrono::steady_clock;
+
+    // Timers never fire early, but may fire up to this late.
+    static constexpr std::chrono::milliseconds resolution{10};
+
+
+    struct stats {
+        std::uint64_t wakeups = 0;
+        std::uint64_t fired = 0;
+        std::uint64_t canceled = 0;
+    };
+
+private:
+
+    static constexpr unsigned num_levels = 4;
+    static constexpr unsigned level_bits = 6;
+    static constexpr unsigned num_slots = 1u << level_bits;
+
+
+    struct node {
+        std::uint64_t expire;   // tick
+        small_task callback;
+        node* prev = nullptr;
+        node* next = nullptr;
+        unsigned level = 0;
+        unsigned slot = 0;
+        // Keeps the node alive while it's in the wheel.
+        std::shared_ptr<node> self;
+    };
+
+
+    std::mutex mutex;
+    std::condition_variable_any cond;
+    std::jthread thread;
+    bool changed = false; // a timer was scheduled, the thread must check the wheel again
+
+    const clock::time_point epoch = clock::now();
+    std::uint64_t next_tick = 0; // first tick not processed yet
+
+    std::array<std::array<node*, num_slots>, num_levels> slots{};
+    std::array<std::uint64_t, num_levels> occupied{}; // bitmap of non-empty slots
+
+    stats counters;
+
+
+    // Note: all private functions below assume the mutex is locked.
+
+    std::uint64_t to_tick(clock::time_point t, bool round_up) const noexcept;
+    clock::time_point to_time(std::uint64_t tick) const noexcept;
+
+    void link(node* n) noexcept;
+    void unlink(node* n) noexcept;
+
+    std::optional<std::uint64_t> next_event() const noexcept;
+
+    // Process all ticks up to now, collecting the timers that expired.
+    void advance(std::uint64_t now, std::vector<std::shared_ptr<node>>& due);
+
+    void loop(std::stop_token token);
+
+public:
+
+    class handle {
+
+        timer_wheel* wheel = nullptr;
+        std::weak_ptr<node> timer;
+
+        friend class timer_wheel;
+
+    public:
+
+        handle() noexcept = default;
+
+
+        // Returns false if the timer already fired, or was already canceled.
+        bool cancel();
+
+    };
+
+
+    timer_wheel() = default;
+
+    // Pending timers are discarded.
+    ~timer_wheel();
+
+
+    handle schedule_at(clock::time_point when, small_task callback);
+
+
+    handle
+    schedule_after(clock::duration delay,
+                   small_task callback)
+    {
+        return schedule_at(clock::now() + delay, std::move(callback));
+    }
+
+
+    // Join the timer thread; pending timers are kept, and it starts again if another
+    // timer is scheduled.
+    void stop();
+
+
+    stats get_stats();
+
+};
+
+
+using timer_handle = timer_wheel::handle;
+
+#endif
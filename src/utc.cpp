@@ -6,6 +6,8 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <chrono>
+
 #include <coreinit/time.h>
 
 #include "utc.hpp"
@@ -13,22 +15,94 @@
 #include "cfg.hpp"
 
 
+using namespace std::literals;
+
+
 namespace utc {
 
-    static
-    dbl_seconds
-    local_time()
+    namespace {
+
+        // Compile-time checks for the conversions, using the Wii U tick rate.
+
+        constexpr std::uint32_t rate = 248'625'000 / 4;
+
+        constexpr auto wiiu_epoch = ntp::timestamp::from_raw(std::uint64_t{epoch_diff} << 32);
+        static_assert(to_ntp({0}, rate) == wiiu_epoch);
+        static_assert(to_utc(wiiu_epoch, rate).ticks == 0);
+
+        // Round trips must be exact.
+        constexpr timestamp sample{ 1'234'567'890'123'456'789 % (std::int64_t{rate} << 32) };
+        static_assert(to_utc(to_ntp(sample, rate), rate).ticks == sample.ticks);
+        constexpr timestamp one_tick{1};
+        static_assert(to_utc(to_ntp(one_tick, rate), rate).ticks == 1);
+
+        // The 2036 NTP era boundary: 2^32 s after 1900.
+        constexpr timestamp era1{ (0x1'0000'0000 - std::int64_t{epoch_diff}) * rate };
+        static_assert(to_ntp(era1, rate) == ntp::timestamp{});
+        constexpr auto era1_plus_1s = ntp::timestamp::from_raw(1ull << 32);
+        static_assert(to_utc(era1_plus_1s, rate).ticks == era1.ticks + rate);
+
+        static_assert(to_ticks(1s, rate) == rate);
+        static_assert(to_ticks(-1s, rate) == -std::int64_t{rate});
+        constexpr ntp::fixed_seconds half_second = ntp::fixed_seconds{1s} / 2;
+        static_assert(to_ticks(half_second, rate) == rate / 2);
+        static_assert(to_ticks(-half_second, rate) == -std::int64_t{rate / 2});
+
+        static_assert(from_ticks(rate, rate) == 1s);
+        static_assert(from_ticks(-std::int64_t{rate}, rate) == -1s);
+        static_assert(from_ticks(rate / 2, rate) == half_second);
+        static_assert(to_ticks(from_ticks(-12345, rate), rate) == -12345);
+
+    } // namespace
+
+
+    timestamp
+    now()
+        noexcept
     {
-        double t = static_cast<double>(OSGetTime()) / OSTimerClockSpeed;
-        return dbl_seconds{t};
+        std::int64_t rate = OSTimerClockSpeed;
+        std::int64_t offset = std::chrono::seconds{cfg::utc_offset}.count() * rate;
+        return { OSGetTime() - offset };
+    }
+
+
+    ntp::timestamp
+    to_ntp(timestamp t)
+        noexcept
+    {
+        return to_ntp(t, OSTimerClockSpeed);
     }
 
 
     timestamp
-    now()
+    to_utc(ntp::timestamp t)
+        noexcept
+    {
+        return to_utc(t, OSTimerClockSpeed);
+    }
+
+
+    std::int64_t
+    to_ticks(ntp::fixed_seconds d)
+        noexcept
+    {
+        return to_ticks(d, OSTimerClockSpeed);
+    }
+
+
+    ntp::fixed_seconds
+    from_ticks(std::int64_t ticks)
+        noexcept
+    {
+        return from_ticks(ticks, OSTimerClockSpeed);
+    }
+
+
+    std::int64_t
+    monotonic_ticks()
         noexcept
     {
-        return timestamp{ local_time() - cfg::utc_offset };
+        return OSGetSystemTime();
     }
 
 } // namespace utc
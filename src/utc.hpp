@@ -9,22 +9,110 @@
 #ifndef UTC_HPP
 #define UTC_HPP
 
-#include "time_utils.hpp"
+#include <cstdint>
 
+#include "ntp.hpp"
 
-namespace utc {
-
-    using time_utils::dbl_seconds;
 
+namespace utc {
 
-    // Seconds since 2000-01-01 00:00:00 UTC
+    // Wii U clock ticks (same as OSTime) since 2000-01-01 00:00:00 UTC
     struct timestamp {
-        dbl_seconds value;
+        std::int64_t ticks;
     };
 
 
+    // Difference from NTP (1900) to Wii U (2000) epochs, in seconds.
+    // There are 24 leap years in this period.
+    constexpr std::uint32_t epoch_diff = 24u * 60 * 60 * (100 * 365 + 24);
+
+
     timestamp now() noexcept;
 
+
+    /*
+     * Exact conversions, for a given tick rate. No floating-point is involved; rounding
+     * only happens below 2^-32 seconds.
+     */
+
+    // Wii U -> NTP epoch.
+    constexpr
+    ntp::timestamp
+    to_ntp(timestamp t, std::uint32_t tick_rate)
+        noexcept
+    {
+        // Split into whole seconds and leftover ticks, so nothing overflows.
+        std::int64_t secs = t.ticks / tick_rate;
+        std::int64_t rem = t.ticks % tick_rate;
+        if (rem < 0) {
+            rem += tick_rate;
+            --secs;
+        }
+        // Note: seconds wrap around in 2036, just like NTP does.
+        std::uint64_t ntp_secs = static_cast<std::uint32_t>(secs + epoch_diff);
+        std::uint64_t frac = (static_cast<std::uint64_t>(rem) << 32) / tick_rate;
+        return ntp::timestamp::from_raw((ntp_secs << 32) | frac);
+    }
+
+
+    // NTP -> Wii U epoch. Valid from 2000 until 2136, across NTP eras.
+    constexpr
+    timestamp
+    to_utc(ntp::timestamp t, std::uint32_t tick_rate)
+        noexcept
+    {
+        std::uint64_t raw = t.load();
+        std::uint32_t secs = static_cast<std::uint32_t>(raw >> 32) - epoch_diff;
+        std::uint64_t frac = raw & 0xffff'ffff;
+        // round to nearest tick
+        std::uint64_t frac_ticks = (frac * tick_rate + 0x8000'0000) >> 32;
+        return { static_cast<std::int64_t>(secs) * tick_rate
+                 + static_cast<std::int64_t>(frac_ticks) };
+    }
+
+
+    // NTP duration -> Wii U ticks.
+    constexpr
+    std::int64_t
+    to_ticks(ntp::fixed_seconds d, std::uint32_t tick_rate)
+        noexcept
+    {
+        std::int64_t secs = d.count() >> 32; // rounds towards -infinity
+        std::uint64_t frac = static_cast<std::uint64_t>(d.count()) & 0xffff'ffff;
+        // round to nearest tick
+        std::uint64_t frac_ticks = (frac * tick_rate + 0x8000'0000) >> 32;
+        return secs * tick_rate + static_cast<std::int64_t>(frac_ticks);
+    }
+
+
+    // Wii U ticks -> NTP duration.
+    constexpr
+    ntp::fixed_seconds
+    from_ticks(std::int64_t ticks, std::uint32_t tick_rate)
+        noexcept
+    {
+        std::int64_t secs = ticks / tick_rate;
+        std::int64_t rem = ticks % tick_rate;
+        if (rem < 0) {
+            rem += tick_rate;
+            --secs;
+        }
+        std::uint64_t frac = (static_cast<std::uint64_t>(rem) << 32) / tick_rate;
+        return ntp::fixed_seconds{static_cast<std::int64_t>((static_cast<std::uint64_t>(secs) << 32)
+                                                            | frac)};
+    }
+
+
+    // Same as above, using the Wii U tick rate.
+    ntp::timestamp to_ntp(timestamp t) noexcept;
+    timestamp to_utc(ntp::timestamp t) noexcept;
+    std::int64_t to_ticks(ntp::fixed_seconds d) noexcept;
+    ntp::fixed_seconds from_ticks(std::int64_t ticks) noexcept;
+
+
+    // Ticks of the monotonic system clock, not affected by changes to the wall clock.
+    std::int64_t monotonic_ticks() noexcept;
+
 } // namespace utc
 
 #endif